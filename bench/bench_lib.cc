@@ -0,0 +1,76 @@
+// Native test library for bench/run.js: no-op and echo functions for every
+// parameter type, plus string and buffer functions whose cost grows with
+// the size of their input.
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32)
+#define BENCH_EXPORT extern "C" __declspec(dllexport)
+#else
+#define BENCH_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+BENCH_EXPORT void BenchNoop() {}
+
+BENCH_EXPORT int8_t BenchEchoInt8(int8_t value) { return value; }
+BENCH_EXPORT uint8_t BenchEchoUint8(uint8_t value) { return value; }
+BENCH_EXPORT int16_t BenchEchoInt16(int16_t value) { return value; }
+BENCH_EXPORT uint16_t BenchEchoUint16(uint16_t value) { return value; }
+BENCH_EXPORT int32_t BenchEchoInt32(int32_t value) { return value; }
+BENCH_EXPORT uint32_t BenchEchoUint32(uint32_t value) { return value; }
+BENCH_EXPORT int64_t BenchEchoInt64(int64_t value) { return value; }
+BENCH_EXPORT uint64_t BenchEchoUint64(uint64_t value) { return value; }
+BENCH_EXPORT float BenchEchoFloat(float value) { return value; }
+BENCH_EXPORT double BenchEchoDouble(double value) { return value; }
+BENCH_EXPORT bool BenchEchoBool(bool value) { return value; }
+BENCH_EXPORT void *BenchEchoPointer(void *value) { return value; }
+BENCH_EXPORT const char *BenchEchoString(const char *value) { return value; }
+BENCH_EXPORT const char16_t *BenchEchoWString(const char16_t *value) { return value; }
+
+BENCH_EXPORT int32_t BenchAddInt32(int32_t a, int32_t b) { return a + b; }
+BENCH_EXPORT double BenchScaleDouble(double value, double factor) { return value * factor; }
+BENCH_EXPORT int32_t BenchSumSix(int32_t a, int32_t b, int32_t c, int32_t d, int32_t e, int32_t f)
+{
+    return a + b + c + d + e + f;
+}
+
+BENCH_EXPORT int32_t BenchStringLength(const char *value)
+{
+    return value ? static_cast<int32_t>(strlen(value)) : -1;
+}
+
+// A string of the requested size from a buffer owned by the library, the
+// way device SDKs return their replies.
+BENCH_EXPORT const char *BenchMakeString(int32_t size)
+{
+    static char buffer[1 << 20];
+    static int32_t filled = 0;
+    static int32_t end = -1;
+    if (size < 0 || static_cast<size_t>(size) >= sizeof(buffer))
+    {
+        return nullptr;
+    }
+    if (end >= 0)
+    {
+        buffer[end] = 'x';
+    }
+    if (filled <= size)
+    {
+        memset(buffer + filled, 'x', static_cast<size_t>(size + 1 - filled));
+        filled = size + 1;
+    }
+    buffer[size] = '\0';
+    end = size;
+    return buffer;
+}
+
+BENCH_EXPORT uint32_t BenchSumBytes(const uint8_t *data, int32_t length)
+{
+    uint32_t sum = 0;
+    for (int32_t i = 0; i < length; i++)
+    {
+        sum += data[i];
+    }
+    return sum;
+}
@@ -0,0 +1,151 @@
+// Compares the prepared call engine with the previous trampoline, which cast
+// every target to eight void* parameters and re-dispatched on the return
+// type through a switch with a boxed result on every call.
+#include "call_engine.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+extern "C"
+{
+    BENCH_NOINLINE int32_t BenchAddInt32(int32_t a, int32_t b) { return a + b; }
+    BENCH_NOINLINE double BenchScaleDouble(double value, double factor) { return value * factor; }
+    BENCH_NOINLINE int32_t BenchSumSix(int32_t a, int32_t b, int32_t c, int32_t d, int32_t e, int32_t f)
+    {
+        return a + b + c + d + e + f;
+    }
+}
+
+enum LegacyType
+{
+    LEGACY_INT32,
+    LEGACY_DOUBLE
+};
+
+static void *LegacyCall(void *funcPtr, LegacyType returnType, const std::vector<void *> &args)
+{
+    void *result = nullptr;
+    switch (returnType)
+    {
+    case LEGACY_INT32:
+    {
+        auto func = reinterpret_cast<int32_t (*)(void *, void *, void *, void *, void *, void *, void *, void *)>(funcPtr);
+        result = new int32_t(func(
+            args.size() > 0 ? args[0] : nullptr,
+            args.size() > 1 ? args[1] : nullptr,
+            args.size() > 2 ? args[2] : nullptr,
+            args.size() > 3 ? args[3] : nullptr,
+            args.size() > 4 ? args[4] : nullptr,
+            args.size() > 5 ? args[5] : nullptr,
+            args.size() > 6 ? args[6] : nullptr,
+            args.size() > 7 ? args[7] : nullptr));
+        break;
+    }
+    case LEGACY_DOUBLE:
+    {
+        auto func = reinterpret_cast<double (*)(void *, void *, void *, void *, void *, void *, void *, void *)>(funcPtr);
+        result = new double(func(
+            args.size() > 0 ? args[0] : nullptr,
+            args.size() > 1 ? args[1] : nullptr,
+            args.size() > 2 ? args[2] : nullptr,
+            args.size() > 3 ? args[3] : nullptr,
+            args.size() > 4 ? args[4] : nullptr,
+            args.size() > 5 ? args[5] : nullptr,
+            args.size() > 6 ? args[6] : nullptr,
+            args.size() > 7 ? args[7] : nullptr));
+        break;
+    }
+    }
+    return result;
+}
+
+template <typename Body>
+static double NanosPerCall(size_t iterations, Body body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+struct Case
+{
+    const char *name;
+    void *funcPtr;
+    LegacyType legacyType;
+    ReturnClass returnClass;
+    std::vector<ArgLoad> loads;
+};
+
+int main(int argc, char **argv)
+{
+    size_t iterations = argc > 1 ? static_cast<size_t>(strtoull(argv[1], nullptr, 10)) : 10000000;
+
+    std::vector<Case> cases = {
+        {"int32(int32,int32)", reinterpret_cast<void *>(BenchAddInt32), LEGACY_INT32, RETURN_INT, {LOAD_I32, LOAD_I32}},
+        {"double(double,double)", reinterpret_cast<void *>(BenchScaleDouble), LEGACY_DOUBLE, RETURN_DOUBLE, {LOAD_F64, LOAD_F64}},
+        {"int32(int32 x6)", reinterpret_cast<void *>(BenchSumSix), LEGACY_INT32, RETURN_INT, {LOAD_I32, LOAD_I32, LOAD_I32, LOAD_I32, LOAD_I32, LOAD_I32}},
+    };
+
+    printf("[\n");
+    for (size_t c = 0; c < cases.size(); c++)
+    {
+        const Case &bench = cases[c];
+        alignas(16) uint8_t frame[128] = {};
+        std::vector<size_t> offsets;
+        for (size_t i = 0; i < bench.loads.size(); i++)
+        {
+            offsets.push_back(i * 8);
+            if (bench.loads[i] == LOAD_F64)
+            {
+                double value = 1.5;
+                memcpy(frame + i * 8, &value, sizeof(value));
+            }
+            else
+            {
+                int32_t value = static_cast<int32_t>(i + 1);
+                memcpy(frame + i * 8, &value, sizeof(value));
+            }
+        }
+
+        CallInterface cif;
+        cif.Prepare(ABI_DEFAULT, bench.returnClass, bench.loads, offsets);
+
+        volatile uint64_t sink = 0;
+        double legacyNs = NanosPerCall(iterations, [&](size_t)
+                                       {
+            std::vector<void *> args;
+            for (size_t i = 0; i < bench.loads.size(); i++)
+            {
+                args.push_back(frame + offsets[i]);
+            }
+            void *result = LegacyCall(bench.funcPtr, bench.legacyType, args);
+            sink = sink + *static_cast<uint8_t *>(result);
+            if (bench.legacyType == LEGACY_DOUBLE)
+                delete static_cast<double *>(result);
+            else
+                delete static_cast<int32_t *>(result); });
+
+        double engineNs = NanosPerCall(iterations, [&](size_t)
+                                       {
+            uint64_t result;
+            cif.Invoke(bench.funcPtr, frame, &result);
+            sink = sink + static_cast<uint8_t>(result); });
+
+        printf("  {\"signature\": \"%s\", \"iterations\": %zu, \"legacyNsPerCall\": %.2f, \"engineNsPerCall\": %.2f}%s\n",
+               bench.name, iterations, legacyNs, engineNs, c + 1 < cases.size() ? "," : "");
+    }
+    printf("]\n");
+
+    return 0;
+}
@@ -0,0 +1,265 @@
+// Calls functions of known signatures through the call engine and compares
+// each result with a direct call, which the compiler makes with the
+// platform's own ABI. Prints one line per case and exits with 1 when any
+// result differs.
+#include "call_engine.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_MSC_VER)
+#define CHECK_NOINLINE __declspec(noinline)
+#else
+#define CHECK_NOINLINE __attribute__((noinline))
+#endif
+
+struct Check12
+{
+    float x, y, z;
+    bool operator==(const Check12 &o) const { return x == o.x && y == o.y && z == o.z; }
+};
+
+struct Check12Int
+{
+    int32_t a, b, c;
+    bool operator==(const Check12Int &o) const { return a == o.a && b == o.b && c == o.c; }
+};
+
+struct Check16
+{
+    int64_t a;
+    double b;
+    bool operator==(const Check16 &o) const { return a == o.a && b == o.b; }
+};
+
+struct Check24
+{
+    int64_t a;
+    double b;
+    int32_t c;
+    bool operator==(const Check24 &o) const { return a == o.a && b == o.b && c == o.c; }
+};
+
+extern "C"
+{
+    CHECK_NOINLINE double CheckMixed(int32_t a, double b, int8_t c, float d, int64_t e, uint16_t f, double g)
+    {
+        return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g;
+    }
+
+    CHECK_NOINLINE double CheckSpill(int64_t a, double b, int64_t c, double d, int64_t e, double f, int64_t g, double h,
+                                     int64_t i, double j, int64_t k, double l, int64_t m, double n, int64_t o, double p,
+                                     int64_t q, double r, float s, int8_t t, int32_t u)
+    {
+        return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h + 9 * i + 10 * j + 11 * k + 12 * l + 13 * m +
+               14 * n + 15 * o + 16 * p + 17 * q + 18 * r + 19 * s + 20 * t + 21 * u;
+    }
+
+    CHECK_NOINLINE float CheckHalf(float value, int32_t add)
+    {
+        return value / 2 + add;
+    }
+
+    CHECK_NOINLINE Check12 CheckEcho12(Check12 value, int32_t add)
+    {
+        return {value.x + add, value.y * 2, value.z - add};
+    }
+
+    CHECK_NOINLINE Check12Int CheckEcho12Int(Check12Int value, int32_t add)
+    {
+        return {value.a + add, value.b * 2, value.c - add};
+    }
+
+    CHECK_NOINLINE Check16 CheckEcho16(double scale, Check16 value)
+    {
+        return {value.a * 3, value.b * scale};
+    }
+
+    CHECK_NOINLINE Check24 CheckEcho24(Check24 value, int64_t add)
+    {
+        return {value.a + add, value.b / 2, value.c - 1};
+    }
+
+    // Every integer register is taken before the struct, which then goes to
+    // the stack whole, followed by a stack argument.
+    CHECK_NOINLINE int64_t CheckLateStruct(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f, int64_t g,
+                                           int64_t h, Check16 value, int64_t i)
+    {
+        return a + b + c + d + e + f + g + h + value.a * 100 + static_cast<int64_t>(value.b) * 1000 + i * 10000;
+    }
+
+    CHECK_NOINLINE double CheckSumVariadic(int32_t count, ...)
+    {
+        va_list args;
+        va_start(args, count);
+        double sum = 0;
+        for (int32_t i = 0; i < count; i++)
+        {
+            sum += va_arg(args, double) * (i + 1);
+        }
+        va_end(args);
+        return sum;
+    }
+}
+
+// Argument slots laid out like a CallPlan frame: structs padded to whole
+// words.
+class CheckFrame
+{
+public:
+    template <typename T>
+    void Scalar(ArgLoad load, T value)
+    {
+        size_t offset = Place(sizeof(T));
+        memcpy(bytes + offset, &value, sizeof(T));
+        pieces.push_back({load, offset, false, false, 0});
+    }
+
+    template <typename T>
+    void Composite(const CompositeType &type, const T &value)
+    {
+        size_t offset = Place(sizeof(T));
+        memcpy(bytes + offset, &value, sizeof(T));
+        AppendCompositePieces(type, offset, pieces);
+    }
+
+    alignas(16) uint8_t bytes[1024] = {};
+    std::vector<ArgPiece> pieces;
+
+private:
+    size_t Place(size_t size)
+    {
+        size_t offset = used;
+        used += (size + 15) / 16 * 16;
+        return offset;
+    }
+
+    size_t used = 0;
+};
+
+static int failures = 0;
+
+template <typename R>
+static void Check(const char *name, void *funcPtr, ReturnClass returnClass, const CheckFrame &frame, const R &expected)
+{
+    CallInterface cif;
+    cif.Prepare(ABI_DEFAULT, returnClass, std::max(sizeof(R), sizeof(uint64_t)), frame.pieces);
+
+    alignas(16) uint8_t result[kMaxIndirectResult] = {};
+    cif.Invoke(funcPtr, frame.bytes, result);
+
+    R actual;
+    memcpy(&actual, result, sizeof(R));
+    bool ok = actual == expected;
+    printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+    if (!ok)
+    {
+        failures++;
+    }
+}
+
+int main()
+{
+    const CompositeType type12 = {12, 4, {{0, 4, true}, {4, 4, true}, {8, 4, true}}};
+    const CompositeType type12Int = {12, 4, {{0, 4, false}, {4, 4, false}, {8, 4, false}}};
+    const CompositeType type16 = {16, 8, {{0, 8, false}, {8, 8, true}}};
+    const CompositeType type24 = {24, 8, {{0, 8, false}, {8, 8, true}, {16, 4, false}}};
+
+    {
+        CheckFrame frame;
+        frame.Scalar<int32_t>(LOAD_I32, -7);
+        frame.Scalar<double>(LOAD_F64, 2.5);
+        frame.Scalar<int8_t>(LOAD_I8, -3);
+        frame.Scalar<float>(LOAD_F32, 4.5f);
+        frame.Scalar<int64_t>(LOAD_I64, 1LL << 40);
+        frame.Scalar<uint16_t>(LOAD_U16, 65000);
+        frame.Scalar<double>(LOAD_F64, -0.25);
+        Check("mixed int and float registers", reinterpret_cast<void *>(CheckMixed), RETURN_DOUBLE, frame,
+              CheckMixed(-7, 2.5, -3, 4.5f, 1LL << 40, 65000, -0.25));
+    }
+
+    {
+        CheckFrame frame;
+        for (int i = 0; i < 9; i++)
+        {
+            frame.Scalar<int64_t>(LOAD_I64, (i + 1) * 1000003LL);
+            frame.Scalar<double>(LOAD_F64, i + 0.5);
+        }
+        frame.Scalar<float>(LOAD_F32, 1.75f);
+        frame.Scalar<int8_t>(LOAD_I8, -100);
+        frame.Scalar<int32_t>(LOAD_I32, -123456);
+        Check("arguments spilled to the stack", reinterpret_cast<void *>(CheckSpill), RETURN_DOUBLE, frame,
+              CheckSpill(1000003, 0.5, 2000006, 1.5, 3000009, 2.5, 4000012, 3.5, 5000015, 4.5, 6000018, 5.5, 7000021, 6.5,
+                         8000024, 7.5, 9000027, 8.5, 1.75f, -100, -123456));
+    }
+
+    {
+        CheckFrame frame;
+        frame.Scalar<float>(LOAD_F32, 3.5f);
+        frame.Scalar<int32_t>(LOAD_I32, -2);
+        Check("float return", reinterpret_cast<void *>(CheckHalf), RETURN_FLOAT, frame, CheckHalf(3.5f, -2));
+    }
+
+    {
+        Check12 value = {1.5f, -2.25f, 8.0f};
+        CheckFrame frame;
+        frame.Composite(type12, value);
+        frame.Scalar<int32_t>(LOAD_I32, 3);
+        Check("12-byte float struct", reinterpret_cast<void *>(CheckEcho12), GetCompositeReturnClass(type12), frame,
+              CheckEcho12(value, 3));
+    }
+
+    {
+        Check12Int value = {-5, 70000, 123};
+        CheckFrame frame;
+        frame.Composite(type12Int, value);
+        frame.Scalar<int32_t>(LOAD_I32, 9);
+        Check("12-byte integer struct", reinterpret_cast<void *>(CheckEcho12Int), GetCompositeReturnClass(type12Int), frame,
+              CheckEcho12Int(value, 9));
+    }
+
+    {
+        Check16 value = {-(1LL << 35), 6.125};
+        CheckFrame frame;
+        frame.Scalar<double>(LOAD_F64, -4.0);
+        frame.Composite(type16, value);
+        Check("16-byte struct", reinterpret_cast<void *>(CheckEcho16), GetCompositeReturnClass(type16), frame,
+              CheckEcho16(-4.0, value));
+    }
+
+    {
+        Check24 value = {1LL << 50, -9.5, -42};
+        CheckFrame frame;
+        frame.Composite(type24, value);
+        frame.Scalar<int64_t>(LOAD_I64, 17);
+        Check("24-byte struct", reinterpret_cast<void *>(CheckEcho24), GetCompositeReturnClass(type24), frame,
+              CheckEcho24(value, 17));
+    }
+
+    {
+        Check16 value = {7, 3.0};
+        CheckFrame frame;
+        for (int i = 0; i < 8; i++)
+        {
+            frame.Scalar<int64_t>(LOAD_I64, i + 1);
+        }
+        frame.Composite(type16, value);
+        frame.Scalar<int64_t>(LOAD_I64, 5);
+        Check("struct after the integer registers", reinterpret_cast<void *>(CheckLateStruct), RETURN_INT, frame,
+              CheckLateStruct(1, 2, 3, 4, 5, 6, 7, 8, value, 5));
+    }
+
+    {
+        CheckFrame frame;
+        frame.Scalar<int32_t>(LOAD_I32, 3);
+        frame.Scalar<double>(LOAD_F64, 1.5);
+        frame.Scalar<double>(LOAD_F64, -2.0);
+        frame.Scalar<double>(LOAD_F64, 0.25);
+        Check("variadic doubles", reinterpret_cast<void *>(CheckSumVariadic), RETURN_DOUBLE, frame,
+              CheckSumVariadic(3, 1.5, -2.0, 0.25));
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+// Call overhead benchmarks against the native test library built by the
+// ffi_bench_lib target of binding.gyp. Results are printed as JSON.
+//
+//   node bench/run.js [--filter <text>] [--scale <factor>] [--out <file>]
+//   node bench/run.js --check
+//
+// Every run starts with call_engine_check, which calls functions of known
+// signatures through the call engine and fails on a wrong result; --check
+// stops after it.
+//
+// heapBytesPerCall is the growth of the V8 heap over a run divided by the
+// number of calls. The benchmark runs with a young generation large enough
+// that no collection happens during a run; gcDuringRun flags the runs where
+// one did and the figure is a lower bound.
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const { spawnSync } = require('child_process');
+const { PerformanceObserver } = require('perf_hooks');
+
+if (typeof global.gc !== 'function') {
+  const child = spawnSync(process.execPath, ['--expose-gc', '--max-semi-space-size=256', __filename, ...process.argv.slice(2)], {
+    stdio: 'inherit'
+  });
+  process.exit(child.status === null ? 1 : child.status);
+}
+
+function runEngineCheck() {
+  const release = path.join(__dirname, '..', 'build', 'Release');
+  const file = path.join(release, process.platform === 'win32' ? 'call_engine_check.exe' : 'call_engine_check');
+  if (!fs.existsSync(file)) {
+    throw new Error('call_engine_check was not found under ' + release + '; run node-gyp rebuild first');
+  }
+  const check = spawnSync(file, [], { encoding: 'utf8' });
+  process.stderr.write(check.stdout || '');
+  if (check.status !== 0) {
+    process.stderr.write('call_engine_check failed' + (check.error ? ': ' + check.error.message : '') + '\n');
+    process.exit(1);
+  }
+}
+
+runEngineCheck();
+if (process.argv.includes('--check')) process.exit(0);
+
+const { Library } = require('../lib');
+
+function parseArgs(argv) {
+  const args = { filter: '', scale: 1, out: null };
+  for (let i = 0; i < argv.length; i++) {
+    if (argv[i] === '--filter') args.filter = argv[++i];
+    else if (argv[i] === '--scale') args.scale = Number(argv[++i]);
+    else if (argv[i] === '--out') args.out = argv[++i];
+  }
+  return args;
+}
+
+function findBenchLibrary() {
+  const release = path.join(__dirname, '..', 'build', 'Release');
+  const candidates = [
+    'ffi_bench_lib.dll',
+    'ffi_bench_lib.so',
+    'ffi_bench_lib.dylib',
+    path.join('lib.target', 'ffi_bench_lib.so'),
+    path.join('lib.target', 'libffi_bench_lib.so'),
+    'libffi_bench_lib.so',
+    'libffi_bench_lib.dylib'
+  ];
+  for (const candidate of candidates) {
+    const file = path.join(release, candidate);
+    if (fs.existsSync(file)) return file;
+  }
+  throw new Error('ffi_bench_lib was not found under ' + release + '; run node-gyp rebuild first');
+}
+
+const args = parseArgs(process.argv.slice(2));
+const libraryPath = findBenchLibrary();
+
+const definitions = {
+  BenchNoop: ['void', []],
+  BenchEchoInt8: ['int8', ['int8']],
+  BenchEchoUint8: ['uint8', ['uint8']],
+  BenchEchoInt16: ['int16', ['int16']],
+  BenchEchoUint16: ['uint16', ['uint16']],
+  BenchEchoInt32: ['int32', ['int32']],
+  BenchEchoUint32: ['uint32', ['uint32']],
+  BenchEchoInt64: ['int64', ['int64']],
+  BenchEchoUint64: ['uint64', ['uint64']],
+  BenchEchoFloat: ['float', ['float']],
+  BenchEchoDouble: ['double', ['double']],
+  BenchEchoBool: ['bool', ['bool']],
+  BenchEchoPointer: ['pointer', ['pointer']],
+  BenchEchoString: ['string', ['string']],
+  BenchEchoWString: ['wstring', ['wstring']],
+  BenchAddInt32: ['int32', ['int32', 'int32']],
+  BenchScaleDouble: ['double', ['double', 'double']],
+  BenchSumSix: ['int32', ['int32', 'int32', 'int32', 'int32', 'int32', 'int32']],
+  BenchStringLength: ['int32', ['string']],
+  BenchMakeString: ['string', ['int32']],
+  BenchSumBytes: ['uint32', ['buffer', 'int32']]
+};
+
+const lib = new Library(libraryPath, definitions);
+const stringLibs = {};
+for (const mode of ['latin1', 'buffer', 'external']) {
+  stringLibs[mode] = new Library(libraryPath, {
+    BenchMakeString: ['string', ['int32'], { returnString: mode }]
+  });
+}
+
+let gcCount = 0;
+new PerformanceObserver((list) => {
+  gcCount += list.getEntries().length;
+}).observe({ entryTypes: ['gc'] });
+
+const results = [];
+
+function record(name, kind, calls, elapsedNs, heapBytes, collections) {
+  const result = {
+    name,
+    kind,
+    calls,
+    nsPerCall: Number((elapsedNs / calls).toFixed(2)),
+    heapBytesPerCall: Number((Math.max(heapBytes, 0) / calls).toFixed(2)),
+    gcDuringRun: collections > 0
+  };
+  results.push(result);
+  process.stderr.write(`${name.padEnd(32)} ${String(result.nsPerCall).padStart(10)} ns/call ${String(result.heapBytesPerCall).padStart(10)} B/call\n`);
+}
+
+function selected(name) {
+  return !args.filter || name.includes(args.filter);
+}
+
+function benchSync(name, calls, body) {
+  if (!selected(name)) return;
+  calls = Math.max(1, Math.round(calls * args.scale));
+  for (let i = 0; i < Math.min(calls, 10000); i++) body(i);
+
+  global.gc();
+  const collections = gcCount;
+  const heapBefore = process.memoryUsage().heapUsed;
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < calls; i++) body(i);
+  const elapsed = Number(process.hrtime.bigint() - start);
+  const heapBytes = process.memoryUsage().heapUsed - heapBefore;
+  record(name, 'sync', calls, elapsed, heapBytes, gcCount - collections);
+}
+
+async function benchAsync(name, calls, concurrency, body) {
+  if (!selected(name)) return;
+  calls = Math.max(concurrency, Math.round(calls * args.scale));
+
+  global.gc();
+  const collections = gcCount;
+  const heapBefore = process.memoryUsage().heapUsed;
+  const start = process.hrtime.bigint();
+  for (let done = 0; done < calls; done += concurrency) {
+    const wave = [];
+    for (let i = 0; i < concurrency; i++) wave.push(body(done + i));
+    await Promise.all(wave);
+  }
+  const elapsed = Number(process.hrtime.bigint() - start);
+  const heapBytes = process.memoryUsage().heapUsed - heapBefore;
+  record(name, 'async', calls, elapsed, heapBytes, gcCount - collections);
+}
+
+function benchBatch(name, rows, repeats, columns, fn) {
+  if (!selected(name)) return;
+  repeats = Math.max(1, Math.round(repeats * args.scale));
+  fn(columns);
+
+  global.gc();
+  const collections = gcCount;
+  const heapBefore = process.memoryUsage().heapUsed;
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < repeats; i++) fn(columns);
+  const elapsed = Number(process.hrtime.bigint() - start);
+  const heapBytes = process.memoryUsage().heapUsed - heapBefore;
+  record(name, 'batch', rows * repeats, elapsed, heapBytes, gcCount - collections);
+}
+
+async function main() {
+  const N = 1000000;
+
+  benchSync('sync/noop', N, () => lib.BenchNoop());
+  benchSync('sync/echo int8', N, (i) => lib.BenchEchoInt8(i & 0x7f));
+  benchSync('sync/echo uint8', N, (i) => lib.BenchEchoUint8(i & 0xff));
+  benchSync('sync/echo int16', N, (i) => lib.BenchEchoInt16(i & 0x7fff));
+  benchSync('sync/echo uint16', N, (i) => lib.BenchEchoUint16(i & 0xffff));
+  benchSync('sync/echo int32', N, (i) => lib.BenchEchoInt32(i));
+  benchSync('sync/echo uint32', N, (i) => lib.BenchEchoUint32(i));
+  benchSync('sync/echo int64', N, () => lib.BenchEchoInt64(-42n));
+  benchSync('sync/echo uint64', N, () => lib.BenchEchoUint64(42n));
+  benchSync('sync/echo float', N, (i) => lib.BenchEchoFloat(i * 0.5));
+  benchSync('sync/echo double', N, (i) => lib.BenchEchoDouble(i * 0.5));
+  benchSync('sync/echo bool', N, (i) => lib.BenchEchoBool((i & 1) === 0));
+  const pointer = lib.BenchEchoPointer(null);
+  benchSync('sync/echo pointer', N, () => lib.BenchEchoPointer(pointer));
+  benchSync('sync/echo string 16', N, () => lib.BenchEchoString('sixteen-chars-xx'));
+  benchSync('sync/echo wstring 16', N, () => lib.BenchEchoWString('sixteen-chars-xx'));
+  benchSync('sync/add int32', N, (i) => lib.BenchAddInt32(i, 1));
+  benchSync('sync/scale double', N, (i) => lib.BenchScaleDouble(i, 0.5));
+  benchSync('sync/sum six int32', N, (i) => lib.BenchSumSix(i, 1, 2, 3, 4, 5));
+
+  for (const size of [16, 1024, 65536]) {
+    const value = 'x'.repeat(size);
+    const calls = Math.max(1000, Math.round(N * 16 / size));
+    benchSync(`string/arg ${size}`, calls, () => lib.BenchStringLength(value));
+    benchSync(`string/return ${size}`, calls, () => lib.BenchMakeString(size));
+    for (const mode of Object.keys(stringLibs)) {
+      benchSync(`string/return ${mode} ${size}`, calls, () => stringLibs[mode].BenchMakeString(size));
+    }
+  }
+
+  for (const size of [64, 65536]) {
+    const buffer = Buffer.alloc(size, 1);
+    const calls = Math.max(1000, Math.round(N * 64 / size));
+    benchSync(`buffer/sum ${size}`, calls, () => lib.BenchSumBytes(buffer, size));
+  }
+
+  await benchAsync('async/noop', N / 10, 256, () => lib.BenchNoop.promise());
+  await benchAsync('async/add int32', N / 10, 256, (i) => lib.BenchAddInt32.promise(i, 1));
+  await benchAsync('async/string return 1024', N / 10, 256, () => lib.BenchMakeString.promise(1024));
+
+  const rows = 10000;
+  const a = new Int32Array(rows).map((_, i) => i);
+  const b = new Int32Array(rows).fill(1);
+  benchBatch('batch/add int32', rows, 200, [a, b], (columns) => lib.BenchAddInt32.batch(columns));
+  const strings = Array.from({ length: rows }, (_, i) => 'row-' + i);
+  benchBatch('batch/string arg', rows, 50, [strings], (columns) => lib.BenchStringLength.batch(columns));
+
+  const report = {
+    node: process.version,
+    platform: process.platform,
+    arch: process.arch,
+    date: new Date().toISOString(),
+    results
+  };
+  const json = JSON.stringify(report, null, 2);
+  if (args.out) {
+    fs.writeFileSync(args.out, json + '\n');
+  } else {
+    process.stdout.write(json + '\n');
+  }
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
@@ -6,7 +6,27 @@
     'sources': [ 
       'src/ffi_loader.cc',
       'src/type_converter.cc',
-      'src/native_function_caller.cc',
+      'src/call_plan.cc',
+      'src/call_frame.cc',
+      'src/array_type.cc',
+      'src/call_engine.cc',
+      'src/call_thunks.cc',
+      'src/batch_call.cc',
+      'src/pipeline.cc',
+      'src/native_task.cc',
+      'src/executor.cc',
+      'src/string_result.cc',
+      'src/external_string.cc',
+      'src/struct_type.cc',
+      'src/callback_trampoline.cc',
+      'src/callback.cc',
+      'src/call_stats.cc',
+      'src/call_sharing.cc',
+      'src/variadic_signatures.cc',
+      'src/memory_pool.cc',
+      'src/native_memory.cc',
+      'src/watcher.cc',
+      'src/shared_library.cc',
       'src/library_wrapper.cc'
     ],
     'include_dirs': [
@@ -18,6 +38,9 @@
     ],
     'conditions': [
       ['OS=="win"', {
+        'sources': [
+          'src/module_loader_win.cc'
+        ],
         'defines': [ 
           'WINDOWS'
         ],
@@ -27,6 +50,65 @@
             'WarningLevel': '0'
           }
         }
+      }, {
+        'sources': [
+          'src/module_loader_posix.cc'
+        ],
+        'libraries': [
+          '-ldl'
+        ],
+        'xcode_settings': {
+          'GCC_ENABLE_CPP_EXCEPTIONS': 'YES'
+        }
+      }]
+    ]
+  }, {
+    'target_name': 'ffi_bench_lib',
+    'type': 'shared_library',
+    'product_prefix': '',
+    'sources': [
+      'bench/bench_lib.cc'
+    ]
+  }, {
+    'target_name': 'call_engine_bench',
+    'type': 'executable',
+    'cflags!': [ '-fno-exceptions' ],
+    'cflags_cc!': [ '-fno-exceptions' ],
+    'sources': [
+      'bench/call_engine_bench.cc',
+      'src/call_engine.cc'
+    ],
+    'include_dirs': [
+      "src"
+    ],
+    'conditions': [
+      ['OS=="win"', {
+        'msvs_settings': {
+          'VCCLCompilerTool': {
+            'ExceptionHandling': 1
+          }
+        }
+      }]
+    ]
+  }, {
+    'target_name': 'call_engine_check',
+    'type': 'executable',
+    'cflags!': [ '-fno-exceptions' ],
+    'cflags_cc!': [ '-fno-exceptions' ],
+    'sources': [
+      'bench/call_engine_check.cc',
+      'src/call_engine.cc'
+    ],
+    'include_dirs': [
+      "src"
+    ],
+    'conditions': [
+      ['OS=="win"', {
+        'msvs_settings': {
+          'VCCLCompilerTool': {
+            'ExceptionHandling': 1
+          }
+        }
       }]
     ]
   }]
@@ -26,30 +26,11 @@ console.log(lib);
 
 async function iniciar() {
   try {
-    const versao = await new Promise((resolve, reject) => {
-      lib.VersaoLib.async((err, result) => {
-        if (err) reject(err);
-        else resolve(result);
-      });
-    });
+    const versao = await lib.VersaoLib.promise();
     console.log('VersaoLib result:', versao);
-    const numeroSessao = await new Promise((resolve, reject) => {
-      lib.GeraNumeroSessao.async((err, result) => {
-        if (err) reject(err);
-        else resolve(result);
-      });
-    });
+    const numeroSessao = await lib.GeraNumeroSessao.promise();
     console.log('GeraNumeroSessao result:', numeroSessao);
-    const sat = await new Promise((resolve, reject) => {
-      lib.ExtrairLogs.async(numeroSessao, '1256584588', (err, result) => {
-        if (err) {
-          console.error('ConsultarSAT error:', err);
-          reject(err);
-        } else {
-          resolve(result);
-        }
-      });
-    });
+    const sat = await lib.ExtrairLogs.promise(numeroSessao, '1256584588');
     console.log('ExtrairLogs result:', sat);
   } catch (error) {
     console.error('Error:', error);
@@ -1,4 +1,29 @@
-type FunctionDefinition = [string, string[]];
+interface FunctionOptions {
+  /** Calling convention, only meaningful on 32-bit x86 */
+  abi?: 'default' | 'cdecl' | 'stdcall';
+  /**
+   * How a `string` result reaches JavaScript: decoded as UTF-8 (default),
+   * as Latin-1, as a Buffer, or as an external string over native memory
+   */
+  returnString?: 'string' | 'latin1' | 'buffer' | 'external';
+  /** Exported `void (void *)` function that releases returned strings */
+  free?: string;
+  /** Concurrent async calls with identical arguments share one native call */
+  coalesce?: boolean;
+  /** Async results are reused for identical arguments for this long */
+  cacheTtlMs?: number;
+  /**
+   * Element count of an array result (`'double[]'`, ...): fixed, or read
+   * from the integer argument at index `param`
+   */
+  returnLength?: number | { param: number };
+}
+
+/**
+ * [returnType, paramTypes, options]. A trailing `'...'` in paramTypes marks
+ * a variadic function, whose extra arguments are `[type, value]` pairs.
+ */
+type FunctionDefinition = [string, string[]] | [string, string[], FunctionOptions];
 
 interface FunctionDefinitions {
   [key: string]: FunctionDefinition;
@@ -6,31 +31,251 @@ interface FunctionDefinitions {
 
 type FFICallback<T> = (error: any, value: T) => void;
 
+/**
+ * One column per parameter: an Array or TypedArray holding the value of every
+ * row, or a single value repeated on all rows. Functions without parameters
+ * take the number of rows instead.
+ */
+type BatchColumns = any[] | number;
+
+export interface BatchFunction {
+  (columns: BatchColumns): any;
+  async(columns: BatchColumns, callback: FFICallback<any>): void;
+  promise(columns: BatchColumns): Promise<any>;
+}
+
 export interface ForeignFunction<TReturn = any, TArgs extends any[] = any[]> {
   (...args: TArgs): TReturn;
   async(...args: [...TArgs, FFICallback<TReturn>]): void;
+  /** Runs the call on a worker thread and settles a native promise */
+  promise(...args: TArgs): Promise<TReturn>;
+  /** Calls the function once per row in a single native crossing */
+  batch: BatchFunction;
+  /**
+   * Converts the leading arguments once and returns a function taking the
+   * remaining ones
+   */
+  prepare(...boundArgs: any[]): PreparedFunction<TReturn>;
+  /**
+   * Polls the function on a native thread and calls onChange with the first
+   * result and then only with results that differ from the previous one
+   */
+  watch(args: TArgs, onChange: FFICallback<TReturn>): WatchHandle;
+  watch(args: TArgs, options: WatchOptions, onChange: FFICallback<TReturn>): WatchHandle;
+}
+
+export interface WatchOptions {
+  /** Milliseconds between the starts of two polls, 1000 by default */
+  intervalMs?: number;
+}
+
+export interface WatchHandle {
+  stop(): void;
+  /** Keeps the process alive while watching (the default) */
+  ref(): WatchHandle;
+  /** Lets the process exit while the watch is running */
+  unref(): WatchHandle;
+}
+
+export interface PreparedFunction<TReturn = any> {
+  (...args: any[]): TReturn;
+  async(...args: [...any[], FFICallback<TReturn>]): void;
+  promise(...args: any[]): Promise<TReturn>;
+}
+
+export interface PipelineOptions {
+  /**
+   * Integer status that means success. When set, the pipeline stops at the
+   * first step whose integer result differs from it.
+   */
+  successCode?: number;
+}
+
+export interface Pipeline {
+  /** Records a call; the arguments are converted immediately */
+  call(name: string, ...args: any[]): Pipeline;
+  /** Runs every recorded call on one worker thread */
+  run(callback: FFICallback<any[]>): void;
+  run(): Promise<any[]>;
+}
+
+export interface ExecutorOptions {
+  /** Worker threads dedicated to this library (default 1, at most 256) */
+  threads?: number;
+  /** Calls that may wait for a thread before new ones are rejected (default 256) */
+  maxQueue?: number;
+}
+
+export interface LoaderOptions {
+  /** RTLD_LAZY (default) or RTLD_NOW */
+  binding?: 'lazy' | 'now';
+  /** RTLD_LOCAL (default) or RTLD_GLOBAL */
+  scope?: 'local' | 'global';
+}
+
+export interface LibraryOptions {
+  /** dlopen flags; ignored on Windows */
+  loader?: LoaderOptions;
+  /**
+   * Runs async calls, batches and pipelines on the library's own threads
+   * instead of the libuv threadpool. With `threads: 1` calls are serialized.
+   */
+  executor?: ExecutorOptions;
+  /**
+   * Resolves each symbol and builds its wrappers on first access instead of
+   * in the constructor. Definitions are read at that point, so the object
+   * passed to the constructor must not change.
+   */
+  lazy?: boolean;
+  /** Records call counts and latency histograms, read with `stats()` */
+  stats?: boolean;
+}
+
+export interface LatencyHistogram {
+  count: number;
+  totalNs: number;
+  meanNs: number;
+  maxNs: number;
+  /** Percentiles, as the upper bound of the bucket they fall in */
+  p50Ns: number;
+  p90Ns: number;
+  p99Ns: number;
+  /** Bucket i counts durations in [2^i, 2^(i+1)) nanoseconds */
+  buckets: number[];
+}
+
+export interface FunctionStats {
+  calls: number;
+  errors: number;
+  marshal: LatencyHistogram;
+  native: LatencyHistogram;
+  /** Async calls only: waiting for a worker */
+  queueWait: LatencyHistogram;
+  /** Async calls only: from the end of the call until the result reaches JS */
+  completion: LatencyHistogram;
+}
+
+export interface LibraryMethods {
+  /** Closes the library and frees resources */
+  close(): void;
+  /** Starts recording a sequence of calls to run on a single worker */
+  pipeline(options?: PipelineOptions): Pipeline;
+  /** Statistics by function name; empty unless created with `stats: true` */
+  stats(options?: { reset?: boolean }): { [name: string]: FunctionStats };
+  /** Plain data describing the library, to post to a worker thread */
+  token(): LibraryToken;
+}
+
+export interface LibraryToken {
+  path: string;
+  definitions: FunctionDefinitions;
+  options?: LibraryOptions;
 }
 
 const ffiBindings = require('bindings')('ffi_libraries');
 
+export interface StructOptions {
+  /** Maximum field alignment, as with `#pragma pack(n)` */
+  pack?: 1 | 2 | 4 | 8 | 16;
+}
+
+export interface StructFields {
+  [field: string]: string;
+}
+
+export interface StructConstructor<T = any> {
+  /**
+   * Creates a zeroed struct, one initialized from a plain object, or a view
+   * over existing memory at an optional byte offset
+   */
+  new (init?: Partial<T> | ArrayBuffer | ArrayBufferView, byteOffset?: number): T & { toObject(): T };
+  /** Size in bytes, including trailing padding */
+  readonly size: number;
+  readonly alignment: number;
+}
+
+/**
+ * Defines a struct type. Its name can then be used as a parameter or return
+ * type (by value), or followed by `*` (by pointer).
+ * @example
+ * const Point = Struct('Point', { x: 'double', y: 'double' });
+ */
+export const Struct: <T = any>(name: string, fields: StructFields, options?: StructOptions) => StructConstructor<T> =
+  ffiBindings.Struct;
+
+export interface CallbackOptions {
+  /** Calling convention the native caller uses, only meaningful on 32-bit x86 */
+  abi?: 'default' | 'cdecl' | 'stdcall';
+}
+
+export interface Callback {
+  /** The native function pointer, or null once closed */
+  readonly address: unknown;
+  /** Releases the native entry point; later native calls through it return 0 */
+  close(): void;
+}
+
+export interface CallbackConstructor {
+  /**
+   * Wraps a JS function in a native function pointer, passed to parameters
+   * of type `callback`. Calls from other threads are delivered in batches on
+   * the event loop; non-void callbacks block the calling thread until JS
+   * returns.
+   */
+  new (returnType: string, paramTypes: string[], fn: (...args: any[]) => any, options?: CallbackOptions): Callback;
+}
+
+export const Callback: CallbackConstructor = ffiBindings.Callback;
+
+export interface NativeMemory {
+  /** Zeroed native memory; small sizes come from a pool. Release with `free` */
+  alloc(size: number): unknown;
+  /** Releases memory from `alloc`; null is ignored */
+  free(ptr: unknown): void;
+  /**
+   * Reads a value of any parameter type or struct name at `ptr + offset`.
+   * Structs come back as views over the memory.
+   */
+  read(ptr: unknown, type: string, offset?: number): any;
+  /** Writes a number, bigint, boolean, pointer or struct at `ptr + offset` */
+  write(ptr: unknown, type: string, value: any, offset?: number): void;
+  /** Decodes a NUL-terminated UTF-8 string, reading at most `maxLength` bytes */
+  readCString(ptr: unknown, offset?: number, maxLength?: number): string | null;
+  /** A view over native memory, valid only while that memory is */
+  toArrayBuffer(ptr: unknown, length: number): ArrayBuffer;
+  /** The pointer moved by a (possibly negative) number of bytes */
+  offset(ptr: unknown, bytes: number): unknown;
+}
+
+export const memory: NativeMemory = ffiBindings.memory;
+
 export interface Library {
   /**
    * @param path Path to the dynamic library
    * @param functions Object containing function definitions
+   * @param options Library-wide options
    */
-  new <T>(path: string, functions: FunctionDefinitions): T;
+  new <T>(path: string, functions: FunctionDefinitions, options?: LibraryOptions): T & LibraryMethods;
 
   /**
    * @param path Path to the dynamic library
    * @param functions Object containing function definitions
+   * @param options Library-wide options
    */
-  <T>(path: string, functions: FunctionDefinitions): T;
+  <T>(path: string, functions: FunctionDefinitions, options?: LibraryOptions): T & LibraryMethods;
+
+  /**
+   * Opens a library from a token made by `lib.token()` on another thread,
+   * reusing the module and compiled signatures already in the process
+   */
+  attach<T>(token: LibraryToken): T & LibraryMethods;
 }
 
 /**
  * Creates a new library instance with function definitions
  * @param {string} path Path to the dynamic library
  * @param {Object} functions Object containing function definitions
+ * @param {Object} [options] Library-wide options
  * @returns {Object} Object containing the defined functions
  * @example
  * const lib = new Library('user32.dll', {
@@ -39,24 +284,21 @@ export interface Library {
  * });
  */
 class LibraryImpl {
-  constructor(path: string, functions: FunctionDefinitions) {
+  constructor(path: string, functions: FunctionDefinitions, options?: LibraryOptions) {
     if (typeof path !== 'string') {
       throw new TypeError('Library path must be a string');
     }
     if (typeof functions !== 'object' || functions === null) {
       throw new TypeError('Functions definition must be an object');
     }
-    const library = new ffiBindings.Library(path, functions);
-    Object.assign(this, library);
+    return new ffiBindings.Library(path, functions, options);
   }
 
-  /**
-   * Closes the library and frees resources
-   */
-  close(): void {
-    if (typeof (this as any).close === 'function') {
-      (this as any).close();
+  static attach(token: LibraryToken) {
+    if (typeof token !== 'object' || token === null) {
+      throw new TypeError('Expected a library token');
     }
+    return new LibraryImpl(token.path, token.definitions, token.options);
   }
 }
 
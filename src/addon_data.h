@@ -0,0 +1,14 @@
+#pragma once
+
+#include <napi.h>
+#include "struct_type.h"
+#include <map>
+#include <string>
+
+// Per-environment state stored with Env::SetInstanceData.
+struct AddonData
+{
+    Napi::FunctionReference libraryConstructor;
+    Napi::FunctionReference pipelineConstructor;
+    std::map<std::string, StructDefinition> structs;
+};
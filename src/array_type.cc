@@ -0,0 +1,324 @@
+#include "array_type.h"
+#include "call_frame.h"
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+template <typename D, typename S>
+static inline D ConvertElement(S value)
+{
+    if (std::is_floating_point<S>::value && std::is_integral<D>::value)
+    {
+        const S low = static_cast<S>(std::numeric_limits<D>::min());
+        const S high = static_cast<S>(std::numeric_limits<D>::max());
+        return value != value ? D(0)
+               : value <= low ? std::numeric_limits<D>::min()
+               : value >= high ? std::numeric_limits<D>::max()
+                               : static_cast<D>(value);
+    }
+    return static_cast<D>(value);
+}
+
+// One plain loop per pair of element types, which the compiler turns into
+// SIMD code for the target.
+template <typename S, typename D>
+static void ConvertRun(const S *__restrict src, D *__restrict dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        dst[i] = ConvertElement<D>(src[i]);
+    }
+}
+
+template <typename S>
+static void ConvertFrom(const S *src, void *dst, ValueType dstType, size_t count)
+{
+    switch (dstType)
+    {
+    case TYPE_INT8:
+        ConvertRun(src, static_cast<int8_t *>(dst), count);
+        break;
+    case TYPE_UINT8:
+        ConvertRun(src, static_cast<uint8_t *>(dst), count);
+        break;
+    case TYPE_INT16:
+        ConvertRun(src, static_cast<int16_t *>(dst), count);
+        break;
+    case TYPE_UINT16:
+        ConvertRun(src, static_cast<uint16_t *>(dst), count);
+        break;
+    case TYPE_INT32:
+        ConvertRun(src, static_cast<int32_t *>(dst), count);
+        break;
+    case TYPE_UINT32:
+        ConvertRun(src, static_cast<uint32_t *>(dst), count);
+        break;
+    case TYPE_INT64:
+        ConvertRun(src, static_cast<int64_t *>(dst), count);
+        break;
+    case TYPE_UINT64:
+        ConvertRun(src, static_cast<uint64_t *>(dst), count);
+        break;
+    case TYPE_FLOAT:
+        ConvertRun(src, static_cast<float *>(dst), count);
+        break;
+    case TYPE_DOUBLE:
+        ConvertRun(src, static_cast<double *>(dst), count);
+        break;
+    default:
+        break;
+    }
+}
+
+void ConvertElements(const void *src, ValueType srcType, void *dst, ValueType dstType, size_t count)
+{
+    switch (srcType)
+    {
+    case TYPE_INT8:
+        ConvertFrom(static_cast<const int8_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_UINT8:
+        ConvertFrom(static_cast<const uint8_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_INT16:
+        ConvertFrom(static_cast<const int16_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_UINT16:
+        ConvertFrom(static_cast<const uint16_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_INT32:
+        ConvertFrom(static_cast<const int32_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_UINT32:
+        ConvertFrom(static_cast<const uint32_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_INT64:
+        ConvertFrom(static_cast<const int64_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_UINT64:
+        ConvertFrom(static_cast<const uint64_t *>(src), dst, dstType, count);
+        break;
+    case TYPE_FLOAT:
+        ConvertFrom(static_cast<const float *>(src), dst, dstType, count);
+        break;
+    case TYPE_DOUBLE:
+        ConvertFrom(static_cast<const double *>(src), dst, dstType, count);
+        break;
+    default:
+        break;
+    }
+}
+
+static ValueType GetTypedArrayElement(napi_env env, napi_typedarray_type arrayType)
+{
+    switch (arrayType)
+    {
+    case napi_int8_array:
+        return TYPE_INT8;
+    case napi_uint8_array:
+    case napi_uint8_clamped_array:
+        return TYPE_UINT8;
+    case napi_int16_array:
+        return TYPE_INT16;
+    case napi_uint16_array:
+        return TYPE_UINT16;
+    case napi_int32_array:
+        return TYPE_INT32;
+    case napi_uint32_array:
+        return TYPE_UINT32;
+    case napi_float32_array:
+        return TYPE_FLOAT;
+    case napi_float64_array:
+        return TYPE_DOUBLE;
+    case napi_bigint64_array:
+        return TYPE_INT64;
+    case napi_biguint64_array:
+        return TYPE_UINT64;
+    default:
+        throw Napi::TypeError::New(env, "Unsupported TypedArray type for an array parameter");
+    }
+}
+
+static napi_typedarray_type GetTypedArrayType(ValueType element)
+{
+    switch (element)
+    {
+    case TYPE_INT8:
+        return napi_int8_array;
+    case TYPE_INT16:
+        return napi_int16_array;
+    case TYPE_UINT16:
+        return napi_uint16_array;
+    case TYPE_INT32:
+        return napi_int32_array;
+    case TYPE_UINT32:
+        return napi_uint32_array;
+    case TYPE_INT64:
+        return napi_bigint64_array;
+    case TYPE_UINT64:
+        return napi_biguint64_array;
+    case TYPE_FLOAT:
+        return napi_float32_array;
+    case TYPE_DOUBLE:
+        return napi_float64_array;
+    default:
+        return napi_uint8_array;
+    }
+}
+
+// N-API has no bulk read of an Array, so elements are fetched one by one as
+// doubles and converted in a single pass afterwards. 64-bit elements also
+// take BigInts and are stored as they are read.
+static void ReadArrayElements(napi_env env, napi_value array, uint32_t length, ValueType element, void *dst,
+                              CallFrame &frame)
+{
+    bool wide = element == TYPE_INT64 || element == TYPE_UINT64;
+    double *numbers = nullptr;
+    if (element == TYPE_DOUBLE)
+    {
+        numbers = static_cast<double *>(dst);
+    }
+    else if (!wide)
+    {
+        numbers = static_cast<double *>(frame.Allocate(length * sizeof(double), alignof(double)));
+    }
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        napi_value item;
+        if (napi_get_element(env, array, i, &item) != napi_ok)
+        {
+            throw Napi::Error::New(env);
+        }
+
+        double number;
+        if (napi_get_value_double(env, item, &number) == napi_ok)
+        {
+            if (numbers)
+            {
+                numbers[i] = number;
+            }
+            else
+            {
+                ConvertElements(&number, TYPE_DOUBLE, static_cast<uint64_t *>(dst) + i, element, 1);
+            }
+            continue;
+        }
+
+        bool lossless;
+        napi_status status = napi_number_expected;
+        if (element == TYPE_INT64)
+        {
+            status = napi_get_value_bigint_int64(env, item, static_cast<int64_t *>(dst) + i, &lossless);
+        }
+        else if (element == TYPE_UINT64)
+        {
+            status = napi_get_value_bigint_uint64(env, item, static_cast<uint64_t *>(dst) + i, &lossless);
+        }
+        if (status != napi_ok)
+        {
+            throw Napi::TypeError::New(env, "Array elements must be numbers");
+        }
+    }
+
+    if (numbers && numbers != dst)
+    {
+        ConvertElements(numbers, TYPE_DOUBLE, dst, element, length);
+    }
+}
+
+void *ConvertArrayToNative(Napi::Value value, ValueType type, CallFrame &frame)
+{
+    napi_env env = value.Env();
+    ValueType element = GetArrayElementType(type);
+    size_t elementSize = GetTypeSize(element);
+
+    if (value.IsTypedArray())
+    {
+        napi_typedarray_type arrayType;
+        size_t length;
+        void *data;
+        if (napi_get_typedarray_info(env, value, &arrayType, &length, &data, nullptr, nullptr) != napi_ok)
+        {
+            throw Napi::Error::New(env);
+        }
+
+        ValueType source = GetTypedArrayElement(env, arrayType);
+        if (source == element)
+        {
+            frame.Retain(value);
+            return data;
+        }
+        void *converted = frame.Allocate(length * elementSize, elementSize);
+        ConvertElements(data, source, converted, element, length);
+        return converted;
+    }
+
+    if (value.IsArray())
+    {
+        uint32_t length;
+        if (napi_get_array_length(env, value, &length) != napi_ok)
+        {
+            throw Napi::Error::New(env);
+        }
+        void *converted = frame.Allocate(length * elementSize, elementSize);
+        ReadArrayElements(env, value, length, element, converted, frame);
+        return converted;
+    }
+
+    throw Napi::TypeError::New(env, "Expected an Array or TypedArray");
+}
+
+Napi::Value ArrayResultToJs(Napi::Env env, ValueType type, const void *data, size_t length)
+{
+    if (!data)
+    {
+        return env.Null();
+    }
+
+    ValueType element = GetArrayElementType(type);
+    size_t byteLength = length * GetTypeSize(element);
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, byteLength);
+    memcpy(buffer.Data(), data, byteLength);
+
+    napi_value result;
+    if (napi_create_typedarray(env, GetTypedArrayType(element), length, buffer, 0, &result) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    return Napi::Value(env, result);
+}
+
+size_t ReadLengthArgument(const void *slot, ValueType type)
+{
+    int64_t length;
+    switch (type)
+    {
+    case TYPE_INT8:
+        length = *static_cast<const int8_t *>(slot);
+        break;
+    case TYPE_UINT8:
+        length = *static_cast<const uint8_t *>(slot);
+        break;
+    case TYPE_INT16:
+        length = *static_cast<const int16_t *>(slot);
+        break;
+    case TYPE_UINT16:
+        length = *static_cast<const uint16_t *>(slot);
+        break;
+    case TYPE_INT32:
+        length = *static_cast<const int32_t *>(slot);
+        break;
+    case TYPE_UINT32:
+        length = *static_cast<const uint32_t *>(slot);
+        break;
+    case TYPE_INT64:
+    case TYPE_UINT64:
+        length = *static_cast<const int64_t *>(slot);
+        break;
+    default:
+        length = 0;
+        break;
+    }
+    return length > 0 ? static_cast<size_t>(length) : 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "common.h"
+
+// Array parameters ('double[]', 'int32[]', ...) take an Array or any
+// TypedArray. A TypedArray of the element type is passed in place, so the
+// callee can write into it; anything else is converted into frame memory.
+void *ConvertArrayToNative(Napi::Value value, ValueType type, CallFrame &frame);
+
+// A TypedArray over one copy of length elements, or null for a null array.
+Napi::Value ArrayResultToJs(Napi::Env env, ValueType type, const void *data, size_t length);
+
+// Converts count numbers between two element types. Integers narrow by
+// truncation, like a C cast; floating point values saturate at the limits
+// of an integer type and NaN becomes 0.
+void ConvertElements(const void *src, ValueType srcType, void *dst, ValueType dstType, size_t count);
+
+// Value of an integer argument giving the length of an array result.
+size_t ReadLengthArgument(const void *slot, ValueType type);
@@ -0,0 +1,389 @@
+#include "batch_call.h"
+#include <cstring>
+
+static bool GetTypedArrayType(ValueType type, napi_typedarray_type &arrayType)
+{
+    switch (type)
+    {
+    case TYPE_INT8:
+        arrayType = napi_int8_array;
+        return true;
+    case TYPE_UINT8:
+    case TYPE_BOOL:
+        arrayType = napi_uint8_array;
+        return true;
+    case TYPE_INT16:
+        arrayType = napi_int16_array;
+        return true;
+    case TYPE_UINT16:
+        arrayType = napi_uint16_array;
+        return true;
+    case TYPE_INT32:
+        arrayType = napi_int32_array;
+        return true;
+    case TYPE_UINT32:
+        arrayType = napi_uint32_array;
+        return true;
+    case TYPE_INT64:
+        arrayType = napi_bigint64_array;
+        return true;
+    case TYPE_UINT64:
+        arrayType = napi_biguint64_array;
+        return true;
+    case TYPE_FLOAT:
+        arrayType = napi_float32_array;
+        return true;
+    case TYPE_DOUBLE:
+        arrayType = napi_float64_array;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static size_t GetTypedElementSize(napi_typedarray_type arrayType)
+{
+    switch (arrayType)
+    {
+    case napi_int16_array:
+    case napi_uint16_array:
+        return 2;
+    case napi_int32_array:
+    case napi_uint32_array:
+    case napi_float32_array:
+        return 4;
+    case napi_float64_array:
+    case napi_bigint64_array:
+    case napi_biguint64_array:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+static double ReadTypedElement(napi_typedarray_type arrayType, const uint8_t *data, size_t index)
+{
+    switch (arrayType)
+    {
+    case napi_int8_array:
+        return reinterpret_cast<const int8_t *>(data)[index];
+    case napi_int16_array:
+        return reinterpret_cast<const int16_t *>(data)[index];
+    case napi_uint16_array:
+        return reinterpret_cast<const uint16_t *>(data)[index];
+    case napi_int32_array:
+        return reinterpret_cast<const int32_t *>(data)[index];
+    case napi_uint32_array:
+        return reinterpret_cast<const uint32_t *>(data)[index];
+    case napi_float32_array:
+        return reinterpret_cast<const float *>(data)[index];
+    case napi_float64_array:
+        return reinterpret_cast<const double *>(data)[index];
+    case napi_bigint64_array:
+        return static_cast<double>(reinterpret_cast<const int64_t *>(data)[index]);
+    case napi_biguint64_array:
+        return static_cast<double>(reinterpret_cast<const uint64_t *>(data)[index]);
+    default:
+        return data[index];
+    }
+}
+
+static void StoreNumber(ValueType type, void *slot, double value)
+{
+    switch (type)
+    {
+    case TYPE_INT8:
+        *static_cast<int8_t *>(slot) = static_cast<int8_t>(value);
+        break;
+    case TYPE_UINT8:
+        *static_cast<uint8_t *>(slot) = static_cast<uint8_t>(value);
+        break;
+    case TYPE_INT16:
+        *static_cast<int16_t *>(slot) = static_cast<int16_t>(value);
+        break;
+    case TYPE_UINT16:
+        *static_cast<uint16_t *>(slot) = static_cast<uint16_t>(value);
+        break;
+    case TYPE_INT32:
+        *static_cast<int32_t *>(slot) = static_cast<int32_t>(value);
+        break;
+    case TYPE_UINT32:
+        *static_cast<uint32_t *>(slot) = static_cast<uint32_t>(value);
+        break;
+    case TYPE_INT64:
+        *static_cast<int64_t *>(slot) = static_cast<int64_t>(value);
+        break;
+    case TYPE_UINT64:
+        *static_cast<uint64_t *>(slot) = static_cast<uint64_t>(value);
+        break;
+    case TYPE_FLOAT:
+        *static_cast<float *>(slot) = static_cast<float>(value);
+        break;
+    case TYPE_DOUBLE:
+        *static_cast<double *>(slot) = value;
+        break;
+    case TYPE_BOOL:
+        *static_cast<bool *>(slot) = value != 0;
+        break;
+    default:
+        break;
+    }
+}
+
+BatchColumns::BatchColumns(const CallPlan &plan, Napi::Value columns)
+    : plan(plan), rows(0)
+{
+    Napi::Env env = columns.Env();
+    // Columns have no room for the [type, value] pairs of extra arguments.
+    if (plan.variadic)
+    {
+        throw Napi::TypeError::New(env, "variadic functions are not supported in batches");
+    }
+    if (columns.IsNumber() && plan.paramTypes.empty())
+    {
+        rows = columns.As<Napi::Number>().Uint32Value();
+        return;
+    }
+
+    if (!columns.IsArray())
+    {
+        throw Napi::TypeError::New(env, "Batch arguments must be an array with one column per parameter");
+    }
+
+    Napi::Array columnArray = columns.As<Napi::Array>();
+    if (columnArray.Length() != plan.paramTypes.size())
+    {
+        throw Napi::TypeError::New(env, "Batch expects " + std::to_string(plan.paramTypes.size()) + " columns");
+    }
+
+    bool sized = false;
+    for (uint32_t i = 0; i < columnArray.Length(); i++)
+    {
+        Column column = {COLUMN_CONSTANT, columnArray.Get(i), nullptr, napi_uint8_array, false};
+        size_t length = 0;
+
+        // A view passed to a buffer, array or struct pointer parameter is the
+        // same memory on every row.
+        if (column.value.IsTypedArray() && !IsBufferType(plan.paramTypes[i]) && !IsArrayType(plan.paramTypes[i]) &&
+            plan.paramTypes[i] != TYPE_STRUCT_PTR)
+        {
+            Napi::TypedArray typed = column.value.As<Napi::TypedArray>();
+            napi_typedarray_type expected;
+            if (!GetTypedArrayType(plan.paramTypes[i], expected))
+            {
+                throw Napi::TypeError::New(env, "Column " + std::to_string(i) + " cannot be a TypedArray");
+            }
+            column.kind = COLUMN_TYPED;
+            column.elementType = typed.TypedArrayType();
+            // Bytes other than 0 and 1 are not valid bools, so those columns
+            // convert like the other paths.
+            column.exact = plan.paramTypes[i] != TYPE_BOOL &&
+                           (column.elementType == expected ||
+                            (expected == napi_uint8_array && column.elementType == napi_uint8_clamped_array));
+            column.data = static_cast<const uint8_t *>(typed.ArrayBuffer().Data()) + typed.ByteOffset();
+            length = typed.ElementLength();
+        }
+        else if (column.value.IsArray())
+        {
+            column.kind = COLUMN_ARRAY;
+            length = column.value.As<Napi::Array>().Length();
+        }
+
+        if (column.kind != COLUMN_CONSTANT)
+        {
+            if (sized && length != rows)
+            {
+                throw Napi::RangeError::New(env, "Batch columns must have the same length");
+            }
+            rows = length;
+            sized = true;
+        }
+        this->columns.push_back(column);
+    }
+
+    if (!sized && !this->columns.empty())
+    {
+        throw Napi::TypeError::New(env, "Batch needs at least one Array or TypedArray column");
+    }
+}
+
+void BatchColumns::MarshalRow(size_t row, CallFrame &frame) const
+{
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        const Column &column = columns[i];
+        ValueType type = plan.paramTypes[i];
+
+        switch (column.kind)
+        {
+        case COLUMN_TYPED:
+            if (column.exact)
+            {
+                size_t size = plan.paramSizes[i];
+                memcpy(frame.Slot(i), column.data + row * size, size);
+            }
+            else
+            {
+                StoreNumber(type, frame.Slot(i), ReadTypedElement(column.elementType, column.data, row));
+            }
+            break;
+        case COLUMN_ARRAY:
+            ConvertJsValueToNative(column.value.As<Napi::Array>().Get(static_cast<uint32_t>(row)), type, frame.Slot(i), frame,
+                                   plan.paramLayouts[i].get());
+            break;
+        default:
+            ConvertJsValueToNative(column.value, type, frame.Slot(i), frame, plan.paramLayouts[i].get());
+            break;
+        }
+    }
+}
+
+BatchResults::BatchResults(Napi::Env env, const CallPlan &plan, size_t rows)
+    : env(env), plan(plan), value(env.Undefined()), data(nullptr)
+{
+    napi_typedarray_type arrayType;
+    if (plan.returnType == TYPE_VOID)
+    {
+        return;
+    }
+
+    if (!GetTypedArrayType(plan.returnType, arrayType))
+    {
+        value = Napi::Array::New(env, rows);
+        return;
+    }
+
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, rows * GetTypedElementSize(arrayType));
+    napi_value typed;
+    napi_status status = napi_create_typedarray(env, arrayType, rows, buffer, 0, &typed);
+    if (status != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    value = Napi::Value(env, typed);
+    data = static_cast<uint8_t *>(buffer.Data());
+}
+
+void BatchResults::Store(size_t row, const CallFrame &frame)
+{
+    if (plan.returnType == TYPE_VOID)
+    {
+        return;
+    }
+
+    if (data)
+    {
+        memcpy(data + row * plan.returnSize, frame.Result(), plan.returnSize);
+    }
+    else
+    {
+        value.As<Napi::Array>().Set(static_cast<uint32_t>(row), frame.ResultToJs(env));
+    }
+}
+
+Napi::Function CreateBatchWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed)
+{
+    return Napi::Function::New(env, [plan, closed](const Napi::CallbackInfo &cbInfo) -> Napi::Value
+                               {
+        Napi::Env cbEnv = cbInfo.Env();
+        CheckOpen(cbEnv, closed);
+
+        try {
+            BatchColumns columns(*plan, cbInfo[0]);
+            BatchResults results(cbEnv, *plan, columns.Rows());
+            CallFrame frame(*plan);
+
+            for (size_t row = 0; row < columns.Rows(); row++) {
+                columns.MarshalRow(row, frame);
+                frame.Invoke();
+                results.Store(row, frame);
+                frame.Reset();
+            }
+
+            return results.Value();
+        } catch (const Napi::Error&) {
+            throw;
+        } catch (const std::exception& e) {
+            throw Napi::Error::New(cbEnv, e.what());
+        } });
+}
+
+Napi::Function CreateBatchAsyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                       std::shared_ptr<Executor> executor, bool promise)
+{
+    return Napi::Function::New(env, [plan, closed, executor, promise](const Napi::CallbackInfo &cbInfo) -> Napi::Value
+                               {
+        Napi::Env cbEnv = cbInfo.Env();
+        CheckOpen(cbEnv, closed);
+
+        try {
+            Napi::Value callback = cbEnv.Undefined();
+
+            if (promise) {
+                if (cbInfo.Length() < 1) {
+                    throw Napi::TypeError::New(cbEnv, "Expected batch columns");
+                }
+            } else {
+                if (cbInfo.Length() < 2 || !cbInfo[cbInfo.Length()-1].IsFunction()) {
+                    throw Napi::TypeError::New(cbEnv, "Last argument must be a callback function");
+                }
+                callback = cbInfo[cbInfo.Length()-1];
+            }
+
+            BatchColumns columns(*plan, cbInfo[0]);
+
+            class BatchTask : public NativeTask {
+            public:
+                BatchTask(Napi::Env env, Napi::Value callback, std::shared_ptr<const CallPlan> plan, size_t rows)
+                    : NativeTask(env, callback),
+                    plan(std::move(plan)), frame(*this->plan, rows) {
+                    frame.RetainValues();
+                }
+
+                CallFrame& Frame() { return frame; }
+
+                void Execute() override {
+                    try {
+                        for (size_t row = 0; row < frame.Rows(); row++) {
+                            frame.Select(row);
+                            frame.Invoke();
+                            if (IsStringType(plan->returnType)) {
+                                frame.OwnResultString();
+                            } else if (IsArrayType(plan->returnType)) {
+                                frame.OwnResultArray();
+                            }
+                        }
+                    } catch (const std::exception& e) {
+                        SetError(e.what());
+                    }
+                }
+
+                void OnOK(Napi::Env env) override {
+                    BatchResults results(env, *plan, frame.Rows());
+                    for (size_t row = 0; row < frame.Rows(); row++) {
+                        frame.Select(row);
+                        results.Store(row, frame);
+                    }
+                    Resolve(env, results.Value());
+                }
+
+            private:
+                std::shared_ptr<const CallPlan> plan;
+                CallFrame frame;
+            };
+
+            std::unique_ptr<BatchTask> task(new BatchTask(cbEnv, callback, plan, columns.Rows()));
+            for (size_t row = 0; row < columns.Rows(); row++) {
+                task->Frame().Select(row);
+                columns.MarshalRow(row, task->Frame());
+            }
+            Napi::Value result = task->Promise(cbEnv);
+            ScheduleTask(cbEnv, executor, std::move(task));
+
+            return result;
+        } catch (const Napi::Error&) {
+            throw;
+        } catch (const std::exception& e) {
+            throw Napi::Error::New(cbEnv, e.what());
+        } });
+}
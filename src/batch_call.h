@@ -0,0 +1,58 @@
+#pragma once
+
+#include "call_frame.h"
+#include "native_task.h"
+
+// Column-wise arguments of fn.batch(): one Array or TypedArray per
+// parameter, or a plain value repeated on every row. Functions without
+// parameters take a row count instead.
+class BatchColumns
+{
+public:
+    BatchColumns(const CallPlan &plan, Napi::Value columns);
+
+    size_t Rows() const { return rows; }
+    void MarshalRow(size_t row, CallFrame &frame) const;
+
+private:
+    enum ColumnKind
+    {
+        COLUMN_CONSTANT,
+        COLUMN_ARRAY,
+        COLUMN_TYPED
+    };
+
+    struct Column
+    {
+        ColumnKind kind;
+        Napi::Value value;
+        const uint8_t *data;
+        napi_typedarray_type elementType;
+        bool exact;
+    };
+
+    const CallPlan &plan;
+    std::vector<Column> columns;
+    size_t rows;
+};
+
+// Per-row results of a batch, stored in a TypedArray for numeric returns and
+// in a JS array for strings and pointers.
+class BatchResults
+{
+public:
+    BatchResults(Napi::Env env, const CallPlan &plan, size_t rows);
+
+    void Store(size_t row, const CallFrame &frame);
+    Napi::Value Value() const { return value; }
+
+private:
+    Napi::Env env;
+    const CallPlan &plan;
+    Napi::Value value;
+    uint8_t *data;
+};
+
+Napi::Function CreateBatchWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed);
+Napi::Function CreateBatchAsyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                       std::shared_ptr<Executor> executor, bool promise);
@@ -0,0 +1,625 @@
+#include "call_engine.h"
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#if defined(FFI_ENGINE_X86)
+#if defined(_MSC_VER)
+#define FFI_CDECL __cdecl
+#define FFI_STDCALL __stdcall
+#else
+#define FFI_CDECL __attribute__((cdecl))
+#define FFI_STDCALL __attribute__((stdcall))
+#endif
+#endif
+
+template <size_t>
+using GprWord = uint64_t;
+template <size_t>
+using FprWord = double;
+template <size_t>
+using StackWord = uintptr_t;
+
+static inline double BitsToDouble(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template <typename R>
+static inline void StoreResult(void *result, size_t resultSize, const R &value)
+{
+    memcpy(result, &value, resultSize < sizeof(R) ? resultSize : sizeof(R));
+}
+
+// Result types whose registers match the struct return classes. A struct
+// larger than any by-value return makes the compiler pass the hidden
+// result pointer exactly as the target expects.
+struct IntPair
+{
+    uint64_t a, b;
+};
+struct DoublePair
+{
+    double a, b;
+};
+struct IntDouble
+{
+    uint64_t a;
+    double b;
+};
+struct DoubleInt
+{
+    double a;
+    uint64_t b;
+};
+struct FloatQuad
+{
+    float v[4];
+};
+struct DoubleQuad
+{
+    double v[4];
+};
+struct IndirectResult
+{
+    uint64_t words[kMaxIndirectResult / sizeof(uint64_t)];
+};
+
+#if defined(FFI_ENGINE_SPLIT_REGISTERS)
+// Integer and floating point arguments use independent register counters,
+// so the target sees the same registers whatever the declared order was.
+template <typename R, typename G, typename F, typename S>
+struct SplitCaller;
+
+template <typename R, size_t... G, size_t... F, size_t... S>
+struct SplitCaller<R, std::index_sequence<G...>, std::index_sequence<F...>, std::index_sequence<S...>>
+{
+    static void Call(void *funcPtr, const CallRegisters &regs, void *result, size_t resultSize)
+    {
+#if defined(FFI_ENGINE_SYSV_X64)
+        // Variadic targets read the number of vector registers used from AL,
+        // which the compiler only sets for calls through a variadic type.
+        // Values land in the same registers either way.
+        typedef R (*Func)(GprWord<G>..., ...);
+#else
+        typedef R (*Func)(GprWord<G>..., FprWord<F>..., StackWord<S>...);
+#endif
+        StoreResult(result, resultSize, reinterpret_cast<Func>(funcPtr)(regs.gpr[G]..., BitsToDouble(regs.fpr[F])..., regs.stack[S]...));
+    }
+};
+
+// On x86-64 the hidden result pointer takes the first integer register.
+template <typename R>
+struct ArgumentRegisters
+{
+    static const size_t value = kIntRegisters;
+};
+
+#if defined(FFI_ENGINE_SYSV_X64)
+template <>
+struct ArgumentRegisters<IndirectResult>
+{
+    static const size_t value = kIntRegisters - 1;
+};
+#endif
+
+template <typename R, size_t N>
+struct Caller : SplitCaller<R, std::make_index_sequence<ArgumentRegisters<R>::value>, std::make_index_sequence<kFloatRegisters>, std::make_index_sequence<N>>
+{
+};
+#elif defined(FFI_ENGINE_WIN64)
+// Win64 assigns registers by position. Calling through a variadic prototype
+// with every argument as a double places each of the first four values in
+// both the integer and the XMM register, so the target finds it either way.
+template <typename R, typename S>
+struct PositionalCaller;
+
+template <typename R, size_t... S>
+struct PositionalCaller<R, std::index_sequence<S...>>
+{
+    static void Call(void *funcPtr, const CallRegisters &regs, void *result, size_t resultSize)
+    {
+        typedef R (*Func)(...);
+        StoreResult(result, resultSize, reinterpret_cast<Func>(funcPtr)(BitsToDouble(regs.stack[S])...));
+    }
+};
+
+template <typename R, size_t N>
+struct Caller : PositionalCaller<R, std::make_index_sequence<N>>
+{
+};
+#elif defined(FFI_ENGINE_X86)
+template <typename R, typename S>
+struct StackCaller;
+
+template <typename R, size_t... S>
+struct StackCaller<R, std::index_sequence<S...>>
+{
+    static void Call(void *funcPtr, const CallRegisters &regs, void *result, size_t resultSize)
+    {
+        typedef R(FFI_CDECL * Func)(StackWord<S>...);
+        StoreResult(result, resultSize, reinterpret_cast<Func>(funcPtr)(regs.stack[S]...));
+    }
+
+    static void CallStd(void *funcPtr, const CallRegisters &regs, void *result, size_t resultSize)
+    {
+        typedef R(FFI_STDCALL * Func)(StackWord<S>...);
+        StoreResult(result, resultSize, reinterpret_cast<Func>(funcPtr)(regs.stack[S]...));
+    }
+};
+
+template <typename R, size_t N>
+struct Caller : StackCaller<R, std::make_index_sequence<N>>
+{
+};
+
+template <typename R, size_t... N>
+static RawInvoker SelectStdcall(size_t words, std::index_sequence<N...>)
+{
+    static const RawInvoker table[] = {&Caller<R, N>::CallStd...};
+    return table[words];
+}
+#endif
+
+template <typename R, size_t... N>
+static RawInvoker Select(size_t words, std::index_sequence<N...>)
+{
+    static const RawInvoker table[] = {&Caller<R, N>::Call...};
+    return table[words];
+}
+
+static RawInvoker SelectInvoker(CallAbi abi, ReturnClass returnClass, size_t words)
+{
+    typedef std::make_index_sequence<kMaxStackWords + 1> AllDepths;
+#if defined(FFI_ENGINE_X86)
+    if (abi == ABI_STDCALL)
+    {
+        switch (returnClass)
+        {
+        case RETURN_FLOAT:
+            return SelectStdcall<float>(words, AllDepths());
+        case RETURN_DOUBLE:
+            return SelectStdcall<double>(words, AllDepths());
+        case RETURN_INDIRECT:
+            return SelectStdcall<IndirectResult>(words, AllDepths());
+        default:
+            return SelectStdcall<uint64_t>(words, AllDepths());
+        }
+    }
+#else
+    (void)abi;
+#endif
+    switch (returnClass)
+    {
+    case RETURN_FLOAT:
+        return Select<float>(words, AllDepths());
+    case RETURN_DOUBLE:
+        return Select<double>(words, AllDepths());
+    case RETURN_INDIRECT:
+        return Select<IndirectResult>(words, AllDepths());
+#if defined(FFI_ENGINE_SPLIT_REGISTERS)
+    case RETURN_INT_PAIR:
+        return Select<IntPair>(words, AllDepths());
+#endif
+#if defined(FFI_ENGINE_SYSV_X64)
+    case RETURN_DOUBLE_PAIR:
+        return Select<DoublePair>(words, AllDepths());
+    case RETURN_INT_DOUBLE:
+        return Select<IntDouble>(words, AllDepths());
+    case RETURN_DOUBLE_INT:
+        return Select<DoubleInt>(words, AllDepths());
+#endif
+#if defined(FFI_ENGINE_AARCH64)
+    case RETURN_HFA_FLOAT:
+        return Select<FloatQuad>(words, AllDepths());
+    case RETURN_HFA_DOUBLE:
+        return Select<DoubleQuad>(words, AllDepths());
+#endif
+    default:
+        return Select<uint64_t>(words, AllDepths());
+    }
+}
+
+static inline bool IsFloatLoad(uint8_t load)
+{
+    return load == LOAD_F32 || load == LOAD_F64;
+}
+
+static inline bool IsWideLoad(uint8_t load)
+{
+    return load == LOAD_I64 || load == LOAD_F64;
+}
+
+static inline uint64_t LoadArgument(uint8_t load, const uint8_t *src)
+{
+    switch (load)
+    {
+    case LOAD_I8:
+    {
+        int8_t value;
+        memcpy(&value, src, sizeof(value));
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+    case LOAD_U8:
+        return *src;
+    case LOAD_I16:
+    {
+        int16_t value;
+        memcpy(&value, src, sizeof(value));
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+    case LOAD_U16:
+    {
+        uint16_t value;
+        memcpy(&value, src, sizeof(value));
+        return value;
+    }
+    case LOAD_I32:
+    {
+        int32_t value;
+        memcpy(&value, src, sizeof(value));
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+    case LOAD_U32:
+    case LOAD_F32:
+    {
+        uint32_t value;
+        memcpy(&value, src, sizeof(value));
+        return value;
+    }
+    case LOAD_PTR:
+    {
+        uintptr_t value;
+        memcpy(&value, src, sizeof(value));
+        return value;
+    }
+    default:
+    {
+        uint64_t value;
+        memcpy(&value, src, sizeof(value));
+        return value;
+    }
+    }
+}
+
+void CallInterface::Prepare(CallAbi abi, ReturnClass returnClass, size_t resultSize, const std::vector<ArgPiece> &pieces)
+{
+    size_t gprLimit = kIntRegisters;
+#if defined(FFI_ENGINE_SYSV_X64)
+    if (returnClass == RETURN_INDIRECT)
+    {
+        gprLimit--;
+    }
+#endif
+    size_t gpr = 0;
+    size_t fpr = 0;
+    size_t words = 0;
+
+    moves.clear();
+    moves.reserve(pieces.size());
+
+    for (size_t first = 0; first < pieces.size();)
+    {
+        size_t end = first + 1;
+        while (end < pieces.size() && pieces[end].joined)
+        {
+            end++;
+        }
+
+        size_t needGpr = 0;
+        size_t needFpr = 0;
+        for (size_t i = first; i < end; i++)
+        {
+            (IsFloatLoad(pieces[i].load) ? needFpr : needGpr)++;
+        }
+
+        bool inRegisters = !pieces[first].inMemory && gpr + needGpr <= gprLimit && fpr + needFpr <= kFloatRegisters;
+        if (inRegisters)
+        {
+            for (size_t i = first; i < end; i++)
+            {
+                ArgMove move;
+                move.offset = static_cast<uint32_t>(pieces[i].offset);
+                move.load = static_cast<uint8_t>(pieces[i].load);
+                if (IsFloatLoad(move.load))
+                {
+                    move.bank = BANK_FPR;
+                    move.index = static_cast<uint16_t>(fpr++);
+                }
+                else
+                {
+                    move.bank = BANK_GPR;
+                    move.index = static_cast<uint16_t>(gpr++);
+                }
+                moves.push_back(move);
+            }
+        }
+        else if (pieces[first].spillSize)
+        {
+            // A struct that does not fit is pushed as its memory image.
+            ArgLoad wordLoad = kStackWordSize == 8 ? LOAD_I64 : LOAD_U32;
+            for (size_t at = 0; at < pieces[first].spillSize; at += kStackWordSize)
+            {
+                ArgMove move;
+                move.offset = static_cast<uint32_t>(pieces[first].offset + at);
+                move.load = static_cast<uint8_t>(wordLoad);
+                move.bank = BANK_STACK;
+                move.index = static_cast<uint16_t>(words++);
+                moves.push_back(move);
+            }
+#if defined(FFI_ENGINE_AARCH64)
+            // AAPCS64 stops allocating the bank a spilled composite asked for.
+            if (needGpr)
+            {
+                gpr = gprLimit;
+            }
+            if (needFpr)
+            {
+                fpr = kFloatRegisters;
+            }
+#endif
+        }
+        else
+        {
+            for (size_t i = first; i < end; i++)
+            {
+                ArgMove move;
+                move.offset = static_cast<uint32_t>(pieces[i].offset);
+                move.load = static_cast<uint8_t>(pieces[i].load);
+                move.bank = BANK_STACK;
+                move.index = static_cast<uint16_t>(words);
+                words += (kStackWordSize == 4 && IsWideLoad(move.load)) ? 2 : 1;
+                moves.push_back(move);
+            }
+        }
+
+        first = end;
+    }
+
+    if (words > kMaxStackWords)
+    {
+        throw std::runtime_error("Function signature needs " + std::to_string(words) +
+                                 " stack words, the limit is " + std::to_string(kMaxStackWords));
+    }
+
+    stackWords = words;
+    this->resultSize = resultSize;
+    invoker = SelectInvoker(abi, returnClass, words);
+}
+
+void CallInterface::Prepare(CallAbi abi, ReturnClass returnClass, const std::vector<ArgLoad> &loads, const std::vector<size_t> &offsets)
+{
+    std::vector<ArgPiece> pieces;
+    pieces.reserve(loads.size());
+    for (size_t i = 0; i < loads.size(); i++)
+    {
+        pieces.push_back({loads[i], offsets[i], false, false, 0});
+    }
+    Prepare(abi, returnClass, sizeof(uint64_t), pieces);
+}
+
+void CallInterface::Invoke(void *funcPtr, const uint8_t *frame, void *result) const
+{
+    CallRegisters regs;
+    memset(regs.gpr, 0, sizeof(regs.gpr));
+    memset(regs.fpr, 0, sizeof(regs.fpr));
+
+    for (const ArgMove &move : moves)
+    {
+        uint64_t value = move.load == LOAD_ADDR ? reinterpret_cast<uintptr_t>(frame + move.offset)
+                                                : LoadArgument(move.load, frame + move.offset);
+        switch (move.bank)
+        {
+        case BANK_GPR:
+            regs.gpr[move.index] = value;
+            break;
+        case BANK_FPR:
+            regs.fpr[move.index] = value;
+            break;
+        default:
+            regs.stack[move.index] = static_cast<uintptr_t>(value);
+            if (kStackWordSize == 4 && IsWideLoad(move.load))
+            {
+                regs.stack[move.index + 1] = static_cast<uintptr_t>(value >> 32);
+            }
+            break;
+        }
+    }
+
+    invoker(funcPtr, regs, result, resultSize);
+}
+
+static void AppendPiece(std::vector<ArgPiece> &pieces, ArgLoad load, size_t offset, bool joined)
+{
+    pieces.push_back({load, offset, joined, false, 0});
+}
+
+#if defined(FFI_ENGINE_SYSV_X64)
+// Classifies each eightbyte: SSE when only floating point members overlap
+// it, INTEGER otherwise. Larger or misaligned structs are MEMORY.
+static bool IsMemoryClass(const CompositeType &type)
+{
+    if (type.size > 16)
+    {
+        return true;
+    }
+    for (const CompositeMember &member : type.members)
+    {
+        if (member.offset % member.size)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool IsFloatingEightbyte(const CompositeType &type, size_t index)
+{
+    bool floating = false;
+    for (const CompositeMember &member : type.members)
+    {
+        if (member.offset / 8 != index)
+        {
+            continue;
+        }
+        if (!member.floating)
+        {
+            return false;
+        }
+        floating = true;
+    }
+    return floating;
+}
+
+void AppendCompositePieces(const CompositeType &type, size_t offset, std::vector<ArgPiece> &pieces)
+{
+    size_t eightbytes = (type.size + 7) / 8;
+    bool memory = IsMemoryClass(type);
+    size_t first = pieces.size();
+
+    for (size_t i = 0; i < eightbytes; i++)
+    {
+        ArgLoad load = !memory && IsFloatingEightbyte(type, i) ? LOAD_F64 : LOAD_I64;
+        AppendPiece(pieces, load, offset + i * 8, i > 0);
+    }
+    pieces[first].inMemory = memory;
+    pieces[first].spillSize = eightbytes * 8;
+}
+
+ReturnClass GetCompositeReturnClass(const CompositeType &type)
+{
+    if (IsMemoryClass(type))
+    {
+        return RETURN_INDIRECT;
+    }
+
+    bool low = IsFloatingEightbyte(type, 0);
+    if (type.size <= 8)
+    {
+        return low ? RETURN_DOUBLE : RETURN_INT;
+    }
+
+    bool high = IsFloatingEightbyte(type, 1);
+    if (low)
+    {
+        return high ? RETURN_DOUBLE_PAIR : RETURN_DOUBLE_INT;
+    }
+    return high ? RETURN_INT_DOUBLE : RETURN_INT_PAIR;
+}
+#elif defined(FFI_ENGINE_AARCH64)
+// Homogeneous floating point aggregates of up to four members travel in
+// vector registers; other structs up to 16 bytes in general registers and
+// larger ones by reference to a copy.
+static bool IsHfa(const CompositeType &type)
+{
+    if (type.members.empty() || type.members.size() > 4)
+    {
+        return false;
+    }
+    for (const CompositeMember &member : type.members)
+    {
+        if (!member.floating || member.size != type.members[0].size)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AppendCompositePieces(const CompositeType &type, size_t offset, std::vector<ArgPiece> &pieces)
+{
+    size_t first = pieces.size();
+
+    if (IsHfa(type))
+    {
+        ArgLoad load = type.members[0].size == sizeof(float) ? LOAD_F32 : LOAD_F64;
+        for (size_t i = 0; i < type.members.size(); i++)
+        {
+            AppendPiece(pieces, load, offset + type.members[i].offset, i > 0);
+        }
+    }
+    else if (type.size <= 16)
+    {
+        for (size_t i = 0; i * 8 < type.size; i++)
+        {
+            AppendPiece(pieces, LOAD_I64, offset + i * 8, i > 0);
+        }
+    }
+    else
+    {
+        AppendPiece(pieces, LOAD_ADDR, offset, false);
+        return;
+    }
+    pieces[first].spillSize = (type.size + 7) / 8 * 8;
+}
+
+ReturnClass GetCompositeReturnClass(const CompositeType &type)
+{
+    if (IsHfa(type))
+    {
+        bool single = type.members[0].size == sizeof(float);
+        if (type.members.size() == 1)
+        {
+            return single ? RETURN_FLOAT : RETURN_DOUBLE;
+        }
+        return single ? RETURN_HFA_FLOAT : RETURN_HFA_DOUBLE;
+    }
+    if (type.size <= 8)
+    {
+        return RETURN_INT;
+    }
+    return type.size <= 16 ? RETURN_INT_PAIR : RETURN_INDIRECT;
+}
+#elif defined(FFI_ENGINE_WIN64)
+// Structs of 1, 2, 4 or 8 bytes are passed and returned like integers of
+// that size; any other size by reference to a copy.
+static ArgLoad GetIntegerLoad(size_t size)
+{
+    switch (size)
+    {
+    case 1:
+        return LOAD_U8;
+    case 2:
+        return LOAD_U16;
+    case 4:
+        return LOAD_U32;
+    case 8:
+        return LOAD_I64;
+    default:
+        return LOAD_ADDR;
+    }
+}
+
+void AppendCompositePieces(const CompositeType &type, size_t offset, std::vector<ArgPiece> &pieces)
+{
+    AppendPiece(pieces, GetIntegerLoad(type.size), offset, false);
+}
+
+ReturnClass GetCompositeReturnClass(const CompositeType &type)
+{
+    return GetIntegerLoad(type.size) == LOAD_ADDR ? RETURN_INDIRECT : RETURN_INT;
+}
+#elif defined(FFI_ENGINE_X86)
+// Structs are pushed by value as 32-bit words. MSVC and MinGW return those
+// of 1, 2, 4 or 8 bytes in EAX:EDX; everything else uses a hidden pointer.
+void AppendCompositePieces(const CompositeType &type, size_t offset, std::vector<ArgPiece> &pieces)
+{
+    for (size_t i = 0; i * 4 < type.size; i++)
+    {
+        AppendPiece(pieces, LOAD_U32, offset + i * 4, i > 0);
+    }
+}
+
+ReturnClass GetCompositeReturnClass(const CompositeType &type)
+{
+#if defined(_WIN32)
+    if (type.size == 1 || type.size == 2 || type.size == 4 || type.size == 8)
+    {
+        return RETURN_INT;
+    }
+#endif
+    return RETURN_INDIRECT;
+}
+#endif
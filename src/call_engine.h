@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Calling conventions selectable per function. On x86-64 and AArch64 there
+// is a single C convention and both names resolve to it.
+enum CallAbi
+{
+    ABI_DEFAULT,
+    ABI_CDECL,
+    ABI_STDCALL
+};
+
+// How an argument is loaded from its frame slot and widened to a register.
+enum ArgLoad
+{
+    LOAD_I8,
+    LOAD_U8,
+    LOAD_I16,
+    LOAD_U16,
+    LOAD_I32,
+    LOAD_U32,
+    LOAD_I64,
+    LOAD_F32,
+    LOAD_F64,
+    LOAD_PTR,
+    LOAD_ADDR // the address of the slot itself, for structs passed by reference
+};
+
+enum ArgBank
+{
+    BANK_GPR,
+    BANK_FPR,
+    BANK_STACK
+};
+
+// Register classes of a result. Structs may come back in a pair of
+// registers, in up to four floating point registers (AArch64), or through
+// a hidden pointer to caller memory.
+enum ReturnClass
+{
+    RETURN_INT,
+    RETURN_FLOAT,
+    RETURN_DOUBLE,
+    RETURN_INT_PAIR,
+    RETURN_DOUBLE_PAIR,
+    RETURN_INT_DOUBLE,
+    RETURN_DOUBLE_INT,
+    RETURN_HFA_FLOAT,
+    RETURN_HFA_DOUBLE,
+    RETURN_INDIRECT
+};
+
+// One register or stack word of an argument. A struct passed by value
+// becomes several pieces that go to registers together or to the stack
+// together; spillSize on its first piece is the size of the memory image
+// pushed instead when they do not fit.
+struct ArgPiece
+{
+    ArgLoad load;
+    size_t offset;
+    bool joined;
+    bool inMemory;
+    size_t spillSize;
+};
+
+// Scalar leaves of a struct, flattened through nested structs.
+struct CompositeMember
+{
+    size_t offset;
+    size_t size;
+    bool floating;
+};
+
+struct CompositeType
+{
+    size_t size;
+    size_t alignment;
+    std::vector<CompositeMember> members;
+};
+
+// Largest struct that can be returned by value.
+const size_t kMaxIndirectResult = 512;
+
+struct ArgMove
+{
+    uint32_t offset;
+    uint8_t load;
+    uint8_t bank;
+    uint16_t index;
+};
+
+#if defined(_M_X64) || defined(__x86_64__)
+#if defined(_WIN32)
+#define FFI_ENGINE_WIN64 1
+const size_t kIntRegisters = 0;
+const size_t kFloatRegisters = 0;
+#else
+#define FFI_ENGINE_SPLIT_REGISTERS 1
+#define FFI_ENGINE_SYSV_X64 1
+const size_t kIntRegisters = 6;
+const size_t kFloatRegisters = 8;
+#endif
+const size_t kStackWordSize = 8;
+#elif defined(__aarch64__) && !defined(__APPLE__)
+#define FFI_ENGINE_SPLIT_REGISTERS 1
+#define FFI_ENGINE_AARCH64 1
+const size_t kIntRegisters = 8;
+const size_t kFloatRegisters = 8;
+const size_t kStackWordSize = 8;
+#elif defined(_M_IX86) || defined(__i386__)
+#define FFI_ENGINE_X86 1
+const size_t kIntRegisters = 0;
+const size_t kFloatRegisters = 0;
+const size_t kStackWordSize = 4;
+#else
+#error "ffi-libraries: unsupported target architecture"
+#endif
+
+const size_t kMaxStackWords = 64;
+
+// True when the compiler's own calling convention is the requested one, so
+// the target can be called through an ordinary typed function pointer.
+inline bool IsNativeAbi(CallAbi abi)
+{
+#if defined(FFI_ENGINE_X86)
+    return abi != ABI_STDCALL;
+#else
+    (void)abi;
+    return true;
+#endif
+}
+
+// Values as they are handed to the target: register banks first, then the
+// outgoing stack words in order. On Win64 every argument is positional and
+// lives in the stack array; the invoker spreads the first four into both
+// register files.
+struct CallRegisters
+{
+    uint64_t gpr[kIntRegisters ? kIntRegisters : 1];
+    uint64_t fpr[kFloatRegisters ? kFloatRegisters : 1];
+    uintptr_t stack[kMaxStackWords];
+};
+
+typedef void (*RawInvoker)(void *funcPtr, const CallRegisters &regs, void *result, size_t resultSize);
+
+void AppendCompositePieces(const CompositeType &type, size_t offset, std::vector<ArgPiece> &pieces);
+ReturnClass GetCompositeReturnClass(const CompositeType &type);
+
+// Call interface prepared once per signature: where every argument goes and
+// which raw invoker matches the return class and stack depth.
+class CallInterface
+{
+public:
+    void Prepare(CallAbi abi, ReturnClass returnClass, size_t resultSize, const std::vector<ArgPiece> &pieces);
+    void Prepare(CallAbi abi, ReturnClass returnClass, const std::vector<ArgLoad> &loads, const std::vector<size_t> &offsets);
+    void Invoke(void *funcPtr, const uint8_t *frame, void *result) const;
+
+    size_t StackWords() const { return stackWords; }
+
+private:
+    std::vector<ArgMove> moves;
+    size_t stackWords = 0;
+    size_t resultSize = sizeof(uint64_t);
+    RawInvoker invoker = nullptr;
+};
@@ -0,0 +1,260 @@
+#include "call_frame.h"
+#include "array_type.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+CallFrame::CallFrame(const CallPlan &plan, size_t rows)
+    : plan(plan), base(storage), current(storage), stride(AlignUp(plan.frameSize, 16)), rows(rows),
+      used(0), capacity(kInlineSize), chunk(nullptr), chunkUsed(0),
+      resultOwnership(plan.freePlan ? STRING_FREE_FUNCTION : STRING_BORROWED),
+      ownedStrings(plan.returnType == TYPE_STRING &&
+                   (plan.freePlan || plan.stringReturn == STRING_BUFFER || plan.stringReturn == STRING_EXTERNAL))
+{
+    size_t frameBytes = stride * rows;
+    if (frameBytes > kInlineSize)
+    {
+        base = static_cast<uint8_t *>(malloc(frameBytes));
+        if (!base)
+        {
+            throw std::bad_alloc();
+        }
+        current = base;
+        capacity = frameBytes;
+    }
+    used = frameBytes;
+
+    for (size_t row = 0; ownedStrings && row < rows; row++)
+    {
+        *reinterpret_cast<char **>(base + row * stride + plan.returnOffset) = nullptr;
+    }
+}
+
+// Strings of rows that failed, or that were never converted because an
+// earlier row failed, are released here whichever row is selected.
+CallFrame::~CallFrame()
+{
+    for (size_t row = 0; ownedStrings && row < rows; row++)
+    {
+        char *str = *reinterpret_cast<char **>(base + row * stride + plan.returnOffset);
+        if (str)
+        {
+            ReleaseString(plan, str, resultOwnership);
+        }
+    }
+    Reset();
+    if (base != storage)
+    {
+        free(base);
+    }
+}
+
+void *CallFrame::Allocate(size_t size, size_t alignment)
+{
+    size_t offset = AlignUp(used, alignment);
+    if (offset + size <= capacity)
+    {
+        used = offset + size;
+        return base + offset;
+    }
+
+    offset = AlignUp(chunkUsed, alignment);
+    if (chunk && offset + size <= kChunkSize)
+    {
+        chunkUsed = offset + size;
+        return chunk + offset;
+    }
+
+    bool dedicated = size > kChunkSize / 2;
+    void *ptr = malloc(dedicated ? size : kChunkSize);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    overflow.push_back(ptr);
+
+    if (dedicated)
+    {
+        return ptr;
+    }
+    chunk = static_cast<uint8_t *>(ptr);
+    chunkUsed = size;
+    return chunk;
+}
+
+void *CallFrame::Spare(size_t alignment, size_t &size)
+{
+    size_t offset = AlignUp(used, alignment);
+    if (offset < capacity)
+    {
+        size = capacity - offset;
+        return base + offset;
+    }
+
+    offset = AlignUp(chunkUsed, alignment);
+    if (chunk && offset < kChunkSize)
+    {
+        size = kChunkSize - offset;
+        return chunk + offset;
+    }
+
+    size = 0;
+    return nullptr;
+}
+
+void CallFrame::Claim(void *ptr, size_t size)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(ptr);
+    if (bytes >= base && bytes < base + capacity)
+    {
+        used = static_cast<size_t>(bytes - base) + size;
+    }
+    else
+    {
+        chunkUsed = static_cast<size_t>(bytes - chunk) + size;
+    }
+}
+
+void CallFrame::Reset()
+{
+    for (void *ptr : overflow)
+    {
+        free(ptr);
+    }
+    overflow.clear();
+    chunk = nullptr;
+    chunkUsed = 0;
+    used = stride * rows;
+}
+
+void CallFrame::Retain(Napi::Value value)
+{
+    if (retainValues)
+    {
+        retained.push_back(Napi::Persistent(value));
+    }
+}
+
+void CallFrame::MarshalArguments(const Napi::CallbackInfo &info, size_t first, size_t count, size_t firstParam)
+{
+    size_t paramCount = plan.paramTypes.size();
+
+    for (size_t i = firstParam; i < paramCount; i++)
+    {
+        if (i - firstParam < count)
+        {
+            Napi::Value value = info[first + i - firstParam];
+            if (i >= plan.fixedParams)
+            {
+                value = value.As<Napi::Array>().Get(uint32_t(1));
+            }
+            ConvertJsValueToNative(value, plan.paramTypes[i], Slot(i), *this, plan.paramLayouts[i].get());
+        }
+        else
+        {
+            memset(Slot(i), 0, plan.paramSizes[i]);
+        }
+    }
+}
+
+void CallFrame::CopyArguments(const CallFrame &source, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(Slot(i), source.Slot(i), plan.paramSizes[i]);
+    }
+}
+
+void CallFrame::Invoke()
+{
+    plan.cif.Invoke(plan.ptr, current, Result());
+}
+
+// Runs on the worker thread, before the library can reuse its buffer. A
+// string the caller frees stays where it is; one that ends up in a Buffer or
+// an external string is copied to the heap so JS can own it.
+void CallFrame::OwnResultString()
+{
+    if (plan.returnType == TYPE_WSTRING)
+    {
+        char16_t **wide = static_cast<char16_t **>(Result());
+        if (*wide)
+        {
+            size_t len = std::char_traits<char16_t>::length(*wide) + 1;
+            char16_t *copy = static_cast<char16_t *>(Allocate(len * sizeof(char16_t), alignof(char16_t)));
+            memcpy(copy, *wide, len * sizeof(char16_t));
+            *wide = copy;
+        }
+        return;
+    }
+
+    char **slot = static_cast<char **>(Result());
+    if (!*slot || resultOwnership == STRING_FREE_FUNCTION)
+    {
+        return;
+    }
+
+    size_t len = strlen(*slot) + 1;
+    char *copy;
+    if (plan.stringReturn == STRING_BUFFER || plan.stringReturn == STRING_EXTERNAL)
+    {
+        copy = static_cast<char *>(malloc(len));
+        if (!copy)
+        {
+            throw std::bad_alloc();
+        }
+        resultOwnership = STRING_MALLOC;
+    }
+    else
+    {
+        copy = static_cast<char *>(Allocate(len, 1));
+    }
+    memcpy(copy, *slot, len);
+    *slot = copy;
+}
+
+size_t CallFrame::ResultLength() const
+{
+    if (plan.returnLengthParam < 0)
+    {
+        return plan.returnLength;
+    }
+    return ReadLengthArgument(Slot(plan.returnLengthParam), plan.paramTypes[plan.returnLengthParam]);
+}
+
+// Also on the worker thread: the array may be a static or reused buffer.
+void CallFrame::OwnResultArray()
+{
+    void **slot = static_cast<void **>(Result());
+    if (*slot)
+    {
+        size_t size = ResultLength() * GetTypeSize(GetArrayElementType(plan.returnType));
+        void *copy = Allocate(size, alignof(uint64_t));
+        memcpy(copy, *slot, size);
+        *slot = copy;
+    }
+}
+
+Napi::Value CallFrame::ResultToJs(Napi::Env env) const
+{
+    if (plan.returnType == TYPE_STRING)
+    {
+        char **slot = static_cast<char **>(Result());
+        char *str = *slot;
+        if (ownedStrings)
+        {
+            *slot = nullptr;
+        }
+        return StringResultToJs(env, plan, str, resultOwnership);
+    }
+    if (IsArrayType(plan.returnType))
+    {
+        return ArrayResultToJs(env, plan.returnType, *static_cast<void **>(Result()), ResultLength());
+    }
+    return ConvertNativeToJsValue(env, Result(), plan.returnType, plan.returnLayout.get());
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "call_plan.h"
+#include "string_result.h"
+#include <cstdint>
+
+// Argument and result storage for one call, or for several rows of the same
+// call when a batch is marshalled up front. Slots are laid out by the
+// CallPlan; the frame only touches the heap when the rows or the string
+// data do not fit in the inline buffer.
+class CallFrame
+{
+public:
+    static const size_t kInlineSize = 512;
+    static const size_t kChunkSize = 4096;
+
+    explicit CallFrame(const CallPlan &plan, size_t rows = 1);
+    ~CallFrame();
+
+    CallFrame(const CallFrame &) = delete;
+    CallFrame &operator=(const CallFrame &) = delete;
+
+    size_t Rows() const { return rows; }
+    void Select(size_t row) { current = base + row * stride; }
+
+    void *Slot(size_t index) const { return current + plan.paramOffsets[index]; }
+    void *Result() const { return current + plan.returnOffset; }
+
+    void *Allocate(size_t size, size_t alignment);
+    void Reset();
+
+    // Free scratch space that can be written before its size is known; Claim
+    // then keeps the bytes actually used.
+    void *Spare(size_t alignment, size_t &size);
+    void Claim(void *ptr, size_t size);
+
+    // Frames that outlive the JS call (async calls, batches, pipelines) keep
+    // the objects whose memory is passed by address alive until destroyed.
+    void RetainValues() { retainValues = true; }
+    void Retain(Napi::Value value);
+
+    // Converts count values starting at info[first] into the parameters
+    // from firstParam on; later parameters are zeroed.
+    void MarshalArguments(const Napi::CallbackInfo &info, size_t first, size_t count, size_t firstParam = 0);
+    // Copies the first count argument slots of a frame of the same plan. The
+    // memory they point to stays owned by that frame.
+    void CopyArguments(const CallFrame &source, size_t count);
+    void Invoke();
+    void OwnResultString();
+    void OwnResultArray();
+    // Element count of an array result.
+    size_t ResultLength() const;
+    // An owned string result passes to JS, even when the conversion fails.
+    Napi::Value ResultToJs(Napi::Env env) const;
+
+private:
+    const CallPlan &plan;
+    alignas(16) uint8_t storage[kInlineSize];
+    uint8_t *base;
+    uint8_t *current;
+    size_t stride;
+    size_t rows;
+    size_t used;
+    size_t capacity;
+    uint8_t *chunk;
+    size_t chunkUsed;
+    std::vector<void *> overflow;
+    std::vector<Napi::Reference<Napi::Value>> retained;
+    bool retainValues = false;
+    StringOwnership resultOwnership;
+    // Results may be strings the frame owns. Their slots start out null and
+    // ResultToJs clears them, so the destructor releases whatever no row
+    // handed over to JS.
+    bool ownedStrings;
+};
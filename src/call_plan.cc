@@ -0,0 +1,302 @@
+#include "call_plan.h"
+#include "struct_type.h"
+#include "variadic_signatures.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Lays out the argument slots and the result slot of a CallFrame.
+static void ComputeFrameLayout(CallPlan &plan)
+{
+    size_t offset = 0;
+    plan.paramOffsets.reserve(plan.paramTypes.size());
+    for (size_t i = 0; i < plan.paramTypes.size(); i++)
+    {
+        offset = AlignUp(offset, plan.paramAlignments[i]);
+        plan.paramOffsets.push_back(offset);
+        offset += plan.paramSizes[i];
+    }
+
+    offset = AlignUp(offset, alignof(uint64_t));
+    plan.returnOffset = offset;
+    offset += AlignUp(std::max(plan.returnSize, sizeof(uint64_t)), sizeof(uint64_t));
+
+    plan.frameSize = offset;
+}
+
+ArgLoad GetArgLoad(ValueType type)
+{
+    switch (type)
+    {
+    case TYPE_INT8:
+        return LOAD_I8;
+    case TYPE_UINT8:
+    case TYPE_BOOL:
+        return LOAD_U8;
+    case TYPE_INT16:
+        return LOAD_I16;
+    case TYPE_UINT16:
+        return LOAD_U16;
+    case TYPE_INT32:
+        return LOAD_I32;
+    case TYPE_UINT32:
+        return LOAD_U32;
+    case TYPE_INT64:
+    case TYPE_UINT64:
+        return LOAD_I64;
+    case TYPE_FLOAT:
+        return LOAD_F32;
+    case TYPE_DOUBLE:
+        return LOAD_F64;
+    default:
+        return LOAD_PTR;
+    }
+}
+
+ReturnClass GetReturnClass(ValueType type)
+{
+    switch (type)
+    {
+    case TYPE_FLOAT:
+        return RETURN_FLOAT;
+    case TYPE_DOUBLE:
+        return RETURN_DOUBLE;
+    default:
+        return RETURN_INT;
+    }
+}
+
+CallAbi GetAbiFromString(const std::string &abiStr, Napi::Env env)
+{
+    if (abiStr == "default")
+        return ABI_DEFAULT;
+    if (abiStr == "cdecl")
+        return ABI_CDECL;
+    if (abiStr == "stdcall")
+        return ABI_STDCALL;
+    throw Napi::TypeError::New(env, "Unknown calling convention: " + abiStr);
+}
+
+// Calls sharing a result must not hand out memory for the native side to
+// fill or a struct view every caller could modify.
+static void CheckShareable(Napi::Env env, const CallPlan &plan)
+{
+    for (ValueType type : plan.paramTypes)
+    {
+        if (IsBufferType(type) || IsArrayType(type) || type == TYPE_STRUCT_PTR || type == TYPE_CALLBACK)
+        {
+            throw Napi::TypeError::New(env, "coalesce and cacheTtlMs need parameters passed by value");
+        }
+    }
+    if (plan.returnType == TYPE_STRUCT || IsArrayType(plan.returnType) || plan.stringReturn == STRING_BUFFER)
+    {
+        throw Napi::TypeError::New(env, "coalesce and cacheTtlMs cannot share struct, array or buffer results");
+    }
+}
+
+std::shared_ptr<const CallPlan> CompileCallPlan(Napi::Env env, const FunctionInfo &funcInfo)
+{
+    auto plan = std::make_shared<CallPlan>();
+    plan->library = funcInfo.library;
+    plan->ptr = funcInfo.ptr;
+    plan->abi = funcInfo.abi;
+    plan->returnType = ResolveType(env, funcInfo.returnType, plan->returnLayout);
+    plan->returnSize = plan->returnType == TYPE_STRUCT ? plan->returnLayout->size : GetTypeSize(plan->returnType);
+    if (plan->returnSize > kMaxIndirectResult)
+    {
+        throw Napi::TypeError::New(env, "Struct return type is too large: " + funcInfo.returnType);
+    }
+
+    plan->paramTypes.reserve(funcInfo.paramTypes.size());
+    plan->paramSizes.reserve(funcInfo.paramTypes.size());
+    plan->paramAlignments.reserve(funcInfo.paramTypes.size());
+    plan->paramLayouts.reserve(funcInfo.paramTypes.size());
+
+    for (const std::string &typeStr : funcInfo.paramTypes)
+    {
+        std::shared_ptr<const StructLayout> layout;
+        ValueType type = ResolveType(env, typeStr, layout);
+        if (type == TYPE_VOID)
+        {
+            throw Napi::TypeError::New(env, "Parameter type cannot be void");
+        }
+        plan->paramTypes.push_back(type);
+        if (type == TYPE_STRUCT)
+        {
+            // Padded to whole words: the engine moves struct arguments into
+            // registers eight bytes at a time.
+            plan->paramSizes.push_back(AlignUp(layout->size, sizeof(uint64_t)));
+            plan->paramAlignments.push_back(std::max(layout->alignment, alignof(uint64_t)));
+        }
+        else
+        {
+            plan->paramSizes.push_back(GetTypeSize(type));
+            plan->paramAlignments.push_back(GetTypeAlignment(type));
+        }
+        plan->paramLayouts.push_back(layout);
+    }
+
+    ComputeFrameLayout(*plan);
+
+    std::vector<ArgPiece> pieces;
+    pieces.reserve(plan->paramTypes.size());
+    for (size_t i = 0; i < plan->paramTypes.size(); i++)
+    {
+        if (plan->paramTypes[i] == TYPE_STRUCT)
+        {
+            AppendCompositePieces(plan->paramLayouts[i]->composite, plan->paramOffsets[i], pieces);
+        }
+        else
+        {
+            pieces.push_back({GetArgLoad(plan->paramTypes[i]), plan->paramOffsets[i], false, false, 0});
+        }
+    }
+
+    ReturnClass returnClass = plan->returnType == TYPE_STRUCT ? GetCompositeReturnClass(plan->returnLayout->composite)
+                                                              : GetReturnClass(plan->returnType);
+
+    try
+    {
+        plan->cif.Prepare(funcInfo.abi, returnClass, std::max(plan->returnSize, sizeof(uint64_t)), pieces);
+    }
+    catch (const std::exception &e)
+    {
+        throw Napi::Error::New(env, e.what());
+    }
+
+    plan->stringReturn = funcInfo.stringReturn;
+    if (funcInfo.freePtr)
+    {
+        FunctionInfo freeInfo;
+        freeInfo.library = funcInfo.library;
+        freeInfo.ptr = funcInfo.freePtr;
+        freeInfo.returnType = "void";
+        freeInfo.paramTypes.push_back("pointer");
+        freeInfo.abi = funcInfo.abi;
+        plan->freePlan = CompileCallPlan(env, freeInfo);
+    }
+    if ((plan->stringReturn != STRING_UTF8 || plan->freePlan) && plan->returnType != TYPE_STRING)
+    {
+        throw Napi::TypeError::New(env, "String return options need a string return type");
+    }
+
+    plan->returnLength = static_cast<size_t>(funcInfo.returnLength);
+    plan->returnLengthParam = funcInfo.returnLengthParam;
+    if (plan->returnLengthParam >= 0)
+    {
+        size_t index = static_cast<size_t>(plan->returnLengthParam);
+        if (index >= plan->paramTypes.size() || plan->paramTypes[index] < TYPE_INT8 || plan->paramTypes[index] > TYPE_UINT64)
+        {
+            throw Napi::TypeError::New(env, "returnLength must name an integer parameter");
+        }
+    }
+    bool hasLength = plan->returnLength || plan->returnLengthParam >= 0;
+    if (hasLength != IsArrayType(plan->returnType))
+    {
+        throw Napi::TypeError::New(env, hasLength ? "returnLength needs an array return type"
+                                                  : "Array return types need a returnLength option");
+    }
+
+    plan->fixedParams = plan->paramTypes.size();
+    plan->coalesce = funcInfo.coalesce;
+    plan->cacheTtlNs = static_cast<uint64_t>(funcInfo.cacheTtlMs * 1e6);
+    if (plan->coalesce || plan->cacheTtlNs)
+    {
+        CheckShareable(env, *plan);
+    }
+
+    if (funcInfo.stats)
+    {
+        plan->stats = std::make_shared<FunctionStats>();
+    }
+
+    if (funcInfo.variadic)
+    {
+        if (!IsNativeAbi(plan->abi))
+        {
+            throw Napi::TypeError::New(env, "Variadic functions use the cdecl convention");
+        }
+        plan->variadic = std::make_shared<VariadicSignatures>(funcInfo, plan->stats);
+    }
+
+    // Thunks marshal and call in one step, which the statistics could not
+    // tell apart, and call through a prototype without the variadic part.
+    plan->thunk = plan->stringReturn == STRING_UTF8 && !plan->freePlan && !plan->stats && !plan->variadic ? FindCallThunk(*plan) : nullptr;
+
+    return plan;
+}
+
+// Plans compiled by every Library in the process, so Library objects created
+// on worker threads for an already loaded module skip compilation. Plans
+// naming structs are not shared, since structs are defined per thread, and
+// neither are plans with statistics, which belong to one library. Variadic
+// plans are not shared either: their extra argument types may name structs
+// too. A live plan keeps its module loaded, so no other module can take over
+// the addresses in its key.
+static std::mutex planCacheMutex;
+static std::map<std::string, std::weak_ptr<const CallPlan>> planCache;
+static size_t planCacheSweepAt = 64;
+
+static std::string GetPlanKey(const FunctionInfo &funcInfo)
+{
+    char prefix[160];
+    snprintf(prefix, sizeof(prefix), "%p:%p:%d:%d:%d:%d:%.17g:%.17g:%d:", funcInfo.ptr, funcInfo.freePtr, static_cast<int>(funcInfo.abi),
+             static_cast<int>(funcInfo.stringReturn), funcInfo.variadic ? 1 : 0, funcInfo.coalesce ? 1 : 0, funcInfo.cacheTtlMs,
+             funcInfo.returnLength, funcInfo.returnLengthParam);
+
+    std::string key = prefix + funcInfo.returnType;
+    for (const std::string &typeStr : funcInfo.paramTypes)
+    {
+        key += ',';
+        key += typeStr;
+    }
+    return key;
+}
+
+static bool NamesStruct(Napi::Env env, const FunctionInfo &funcInfo)
+{
+    auto isStruct = [&](const std::string &typeStr)
+    {
+        std::string name = !typeStr.empty() && typeStr.back() == '*' ? typeStr.substr(0, typeStr.size() - 1) : typeStr;
+        return FindStruct(env, name) != nullptr;
+    };
+    return isStruct(funcInfo.returnType) || std::any_of(funcInfo.paramTypes.begin(), funcInfo.paramTypes.end(), isStruct);
+}
+
+std::shared_ptr<const CallPlan> GetCallPlan(Napi::Env env, const FunctionInfo &funcInfo)
+{
+    if (funcInfo.stats || funcInfo.variadic || NamesStruct(env, funcInfo))
+    {
+        return CompileCallPlan(env, funcInfo);
+    }
+
+    std::string key = GetPlanKey(funcInfo);
+    {
+        std::lock_guard<std::mutex> lock(planCacheMutex);
+        auto it = planCache.find(key);
+        std::shared_ptr<const CallPlan> plan = it != planCache.end() ? it->second.lock() : nullptr;
+        if (plan)
+        {
+            return plan;
+        }
+    }
+
+    std::shared_ptr<const CallPlan> plan = CompileCallPlan(env, funcInfo);
+
+    std::lock_guard<std::mutex> lock(planCacheMutex);
+    planCache[key] = plan;
+    if (planCache.size() >= planCacheSweepAt)
+    {
+        for (auto it = planCache.begin(); it != planCache.end();)
+        {
+            it = it->second.expired() ? planCache.erase(it) : std::next(it);
+        }
+        planCacheSweepAt = std::max<size_t>(64, planCache.size() * 2);
+    }
+    return plan;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "common.h"
+#include "call_engine.h"
+#include "call_thunks.h"
+#include "call_stats.h"
+#include <memory>
+
+class SharedLibrary;
+class VariadicSignatures;
+
+struct FunctionInfo
+{
+    std::shared_ptr<SharedLibrary> library;
+    void *ptr;
+    std::string returnType;
+    std::vector<std::string> paramTypes;
+    // Declared with a trailing '...'; paramTypes holds the fixed parameters.
+    bool variadic = false;
+    CallAbi abi = ABI_DEFAULT;
+    StringReturn stringReturn = STRING_UTF8;
+    void *freePtr = nullptr;
+    bool stats = false;
+    bool coalesce = false;
+    double cacheTtlMs = 0;
+    // Element count of an array result: fixed, or the value of the integer
+    // parameter returnLengthParam when that is not -1.
+    double returnLength = 0;
+    int returnLengthParam = -1;
+};
+
+// Signature compiled once per definition; the call wrappers only read it.
+struct CallPlan
+{
+    // The module of ptr and of the free function, loaded for as long as a
+    // wrapper, a pending call or a string finalizer holds the plan.
+    std::shared_ptr<SharedLibrary> library;
+    void *ptr;
+    CallAbi abi;
+    ValueType returnType;
+    size_t returnSize;
+    std::vector<ValueType> paramTypes;
+    std::vector<size_t> paramSizes;
+    std::vector<size_t> paramAlignments;
+    std::vector<size_t> paramOffsets;
+    // Struct layout of each TYPE_STRUCT or TYPE_STRUCT_PTR parameter, null
+    // for the other types.
+    std::vector<std::shared_ptr<const StructLayout>> paramLayouts;
+    std::shared_ptr<const StructLayout> returnLayout;
+    size_t returnOffset;
+    size_t frameSize;
+    CallInterface cif;
+    CallThunk thunk;
+    StringReturn stringReturn;
+    // void(void *) taking ownership of returned strings, or null when the
+    // library keeps them.
+    std::shared_ptr<const CallPlan> freePlan;
+    // Counters of a library created with { stats: true }, null otherwise.
+    std::shared_ptr<FunctionStats> stats;
+    // Async calls with the same arguments share one native call, and with a
+    // TTL its result; see CallSharing.
+    bool coalesce;
+    uint64_t cacheTtlNs;
+    // Parameters after fixedParams are the extra arguments of a variadic
+    // call, passed as [type, value] pairs. The plan of the declared
+    // signature holds the plans per shape of extra arguments.
+    size_t fixedParams;
+    std::shared_ptr<VariadicSignatures> variadic;
+    // Element count of an array result; see FunctionInfo.
+    size_t returnLength;
+    int returnLengthParam;
+};
+
+// Shared by a Library and the wrappers of its functions; close() sets it,
+// after which they throw instead of calling. JS thread only.
+typedef std::shared_ptr<const bool> ClosedFlag;
+
+inline void CheckOpen(Napi::Env env, const ClosedFlag &closed)
+{
+    if (*closed)
+    {
+        throw Napi::Error::New(env, "Library is closed");
+    }
+}
+
+CallAbi GetAbiFromString(const std::string &abiStr, Napi::Env env);
+ArgLoad GetArgLoad(ValueType type);
+ReturnClass GetReturnClass(ValueType type);
+std::shared_ptr<const CallPlan> CompileCallPlan(Napi::Env env, const FunctionInfo &funcInfo);
+// CompileCallPlan through a process-wide cache shared by all threads.
+std::shared_ptr<const CallPlan> GetCallPlan(Napi::Env env, const FunctionInfo &funcInfo);
@@ -0,0 +1,195 @@
+#include "call_sharing.h"
+#include "call_frame.h"
+#include "call_stats.h"
+#include "struct_type.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+CallSharing::CallSharing(const CallPlan &plan)
+    : coalesce(plan.coalesce), ttlNs(plan.cacheTtlNs)
+{
+}
+
+static void AppendBytes(std::string &key, const void *data, size_t size)
+{
+    key.append(static_cast<const char *>(data), size);
+}
+
+std::string CallSharing::Key(const CallPlan &plan, const CallFrame &frame)
+{
+    std::string key;
+    for (size_t i = 0; i < plan.paramTypes.size(); i++)
+    {
+        const void *slot = frame.Slot(i);
+        // The extra arguments of a variadic call carry their type, so equal
+        // bytes passed as different types are different calls.
+        if (i >= plan.fixedParams)
+        {
+            ValueType type = plan.paramTypes[i];
+            AppendBytes(key, &type, sizeof(type));
+            if (plan.paramLayouts[i])
+            {
+                key += plan.paramLayouts[i]->name;
+                key += '\0';
+            }
+        }
+        switch (plan.paramTypes[i])
+        {
+        case TYPE_STRING:
+        case TYPE_WSTRING:
+        {
+            const void *str = *static_cast<void *const *>(slot);
+            size_t length = SIZE_MAX;
+            if (str && plan.paramTypes[i] == TYPE_STRING)
+            {
+                length = strlen(static_cast<const char *>(str));
+            }
+            else if (str)
+            {
+                length = std::char_traits<char16_t>::length(static_cast<const char16_t *>(str)) * sizeof(char16_t);
+            }
+            AppendBytes(key, &length, sizeof(length));
+            if (str)
+            {
+                AppendBytes(key, str, length);
+            }
+            break;
+        }
+        case TYPE_STRUCT:
+            AppendBytes(key, slot, plan.paramLayouts[i]->size);
+            break;
+        default:
+            AppendBytes(key, slot, GetTypeSize(plan.paramTypes[i]));
+            break;
+        }
+    }
+    return key;
+}
+
+bool CallSharing::TryShare(Napi::Env env, const std::string &key, Napi::Value callback, Napi::Value &result)
+{
+    if (ttlNs)
+    {
+        auto cached = cache.find(key);
+        if (cached != cache.end() && cached->second.expiresAt > MonotonicNs())
+        {
+            Napi::Value value = cached->second.value.Value();
+            if (callback.IsFunction())
+            {
+                // Callbacks still run asynchronously.
+                Napi::Object process = env.Global().Get("process").As<Napi::Object>();
+                process.Get("nextTick").As<Napi::Function>().Call(process, {callback, env.Null(), value});
+                result = env.Undefined();
+            }
+            else
+            {
+                Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+                deferred.Resolve(value);
+                result = deferred.Promise();
+            }
+            return true;
+        }
+        if (cached != cache.end())
+        {
+            cache.erase(cached);
+        }
+    }
+
+    if (!coalesce)
+    {
+        return false;
+    }
+
+    auto pending = inFlight.find(key);
+    if (pending == inFlight.end())
+    {
+        inFlight.emplace(key, std::vector<Waiter>());
+        return false;
+    }
+
+    Waiter waiter;
+    if (callback.IsFunction())
+    {
+        waiter.callback = Napi::Persistent(callback.As<Napi::Function>());
+        result = env.Undefined();
+    }
+    else
+    {
+        waiter.deferred.reset(new Napi::Promise::Deferred(env));
+        result = waiter.deferred->Promise();
+    }
+    pending->second.push_back(std::move(waiter));
+    return true;
+}
+
+void CallSharing::Complete(Napi::Env env, const std::string &key, Napi::Value value)
+{
+    if (ttlNs)
+    {
+        uint64_t now = MonotonicNs();
+        if (cache.size() >= sweepAt)
+        {
+            for (auto it = cache.begin(); it != cache.end();)
+            {
+                it = it->second.expiresAt <= now ? cache.erase(it) : std::next(it);
+            }
+            sweepAt = std::max<size_t>(64, cache.size() * 2);
+        }
+
+        CachedResult &cached = cache[key];
+        cached.value = Napi::Persistent(value);
+        cached.expiresAt = now + ttlNs;
+    }
+    Settle(env, key, Napi::Value(), value);
+}
+
+void CallSharing::Fail(Napi::Env env, const std::string &key, const Napi::Error &e)
+{
+    Settle(env, key, e.Value(), env.Undefined());
+}
+
+// A throwing callback is reported as an uncaught exception so the other
+// waiters and the call that ran still settle.
+void CallSharing::Settle(Napi::Env env, const std::string &key, Napi::Value error, Napi::Value value)
+{
+    auto pending = inFlight.find(key);
+    if (pending == inFlight.end())
+    {
+        return;
+    }
+    std::vector<Waiter> waiters = std::move(pending->second);
+    inFlight.erase(pending);
+
+    for (Waiter &waiter : waiters)
+    {
+        if (waiter.deferred)
+        {
+            if (error.IsEmpty())
+            {
+                waiter.deferred->Resolve(value);
+            }
+            else
+            {
+                waiter.deferred->Reject(error);
+            }
+            continue;
+        }
+
+        try
+        {
+            if (error.IsEmpty())
+            {
+                waiter.callback.Call({env.Null(), value});
+            }
+            else
+            {
+                waiter.callback.Call({error, env.Undefined()});
+            }
+        }
+        catch (const Napi::Error &e)
+        {
+            napi_fatal_exception(env, e.Value());
+        }
+    }
+}
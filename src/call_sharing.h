@@ -0,0 +1,48 @@
+#pragma once
+
+#include "call_plan.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+class CallFrame;
+
+// State behind the coalesce and cacheTtlMs function options, one per
+// function object and only used on the JS thread. Calls are identified by
+// their marshalled arguments, with strings compared by content and the
+// extra arguments of variadic calls also by type.
+class CallSharing
+{
+public:
+    explicit CallSharing(const CallPlan &plan);
+
+    static std::string Key(const CallPlan &plan, const CallFrame &frame);
+
+    // Settles the call from the cache or attaches it to an identical call in
+    // flight, storing the promise (or undefined) to return. False when the
+    // caller has to make the call and report it with Complete or Fail.
+    bool TryShare(Napi::Env env, const std::string &key, Napi::Value callback, Napi::Value &result);
+    void Complete(Napi::Env env, const std::string &key, Napi::Value value);
+    void Fail(Napi::Env env, const std::string &key, const Napi::Error &e);
+
+private:
+    struct Waiter
+    {
+        Napi::FunctionReference callback;
+        std::unique_ptr<Napi::Promise::Deferred> deferred;
+    };
+
+    struct CachedResult
+    {
+        Napi::Reference<Napi::Value> value;
+        uint64_t expiresAt;
+    };
+
+    void Settle(Napi::Env env, const std::string &key, Napi::Value error, Napi::Value value);
+
+    bool coalesce;
+    uint64_t ttlNs;
+    std::map<std::string, std::vector<Waiter>> inFlight;
+    std::map<std::string, CachedResult> cache;
+    size_t sweepAt = 64;
+};
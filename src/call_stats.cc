@@ -0,0 +1,109 @@
+#include "call_stats.h"
+
+static size_t BucketOf(uint64_t ns)
+{
+    size_t bucket = 0;
+    while (ns > 1 && bucket + 1 < LatencyHistogram::kBuckets)
+    {
+        ns >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void LatencyHistogram::Record(uint64_t ns)
+{
+    buckets[BucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalNs.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = maxNs.load(std::memory_order_relaxed);
+    while (ns > max && !maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (std::atomic<uint64_t> &bucket : buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    totalNs.store(0, std::memory_order_relaxed);
+    maxNs.store(0, std::memory_order_relaxed);
+}
+
+// Percentiles are reported as the upper bound of the bucket they fall in.
+Napi::Object LatencyHistogram::ToJs(Napi::Env env) const
+{
+    uint64_t snapshot[kBuckets];
+    uint64_t total = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < kBuckets; i++)
+    {
+        snapshot[i] = buckets[i].load(std::memory_order_relaxed);
+        total += snapshot[i];
+        if (snapshot[i])
+        {
+            used = i + 1;
+        }
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    uint64_t samples = count.load(std::memory_order_relaxed);
+    uint64_t sum = totalNs.load(std::memory_order_relaxed);
+    result.Set("count", Napi::Number::New(env, static_cast<double>(samples)));
+    result.Set("totalNs", Napi::Number::New(env, static_cast<double>(sum)));
+    result.Set("meanNs", Napi::Number::New(env, samples ? static_cast<double>(sum) / samples : 0));
+    result.Set("maxNs", Napi::Number::New(env, static_cast<double>(maxNs.load(std::memory_order_relaxed))));
+
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    const char *names[] = {"p50Ns", "p90Ns", "p99Ns"};
+    for (size_t q = 0; q < 3; q++)
+    {
+        uint64_t target = static_cast<uint64_t>(quantiles[q] * static_cast<double>(total));
+        uint64_t seen = 0;
+        double bound = 0;
+        for (size_t i = 0; i < used; i++)
+        {
+            seen += snapshot[i];
+            if (seen > target)
+            {
+                bound = static_cast<double>(uint64_t(1) << (i + 1));
+                break;
+            }
+        }
+        result.Set(names[q], Napi::Number::New(env, bound));
+    }
+
+    Napi::Array histogram = Napi::Array::New(env, used);
+    for (size_t i = 0; i < used; i++)
+    {
+        histogram.Set(static_cast<uint32_t>(i), Napi::Number::New(env, static_cast<double>(snapshot[i])));
+    }
+    result.Set("buckets", histogram);
+    return result;
+}
+
+void FunctionStats::Reset()
+{
+    calls.store(0, std::memory_order_relaxed);
+    errors.store(0, std::memory_order_relaxed);
+    marshal.Reset();
+    native.Reset();
+    queueWait.Reset();
+    completion.Reset();
+}
+
+Napi::Object FunctionStats::ToJs(Napi::Env env) const
+{
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("calls", Napi::Number::New(env, static_cast<double>(calls.load(std::memory_order_relaxed))));
+    result.Set("errors", Napi::Number::New(env, static_cast<double>(errors.load(std::memory_order_relaxed))));
+    result.Set("marshal", marshal.ToJs(env));
+    result.Set("native", native.ToJs(env));
+    result.Set("queueWait", queueWait.ToJs(env));
+    result.Set("completion", completion.ToJs(env));
+    return result;
+}
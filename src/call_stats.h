@@ -0,0 +1,48 @@
+#pragma once
+
+#include <napi.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+inline uint64_t MonotonicNs()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Durations in power-of-two buckets: bucket i counts values in
+// [2^i, 2^(i+1)) nanoseconds. Recording is a few relaxed atomic adds, safe
+// from the JS thread and the workers at once.
+class LatencyHistogram
+{
+public:
+    static const size_t kBuckets = 40;
+
+    void Record(uint64_t ns);
+    void Reset();
+    Napi::Object ToJs(Napi::Env env) const;
+
+private:
+    std::atomic<uint64_t> buckets[kBuckets] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+};
+
+// Counters of one function, allocated only for libraries created with
+// { stats: true }; the wrappers of other libraries never touch them.
+struct FunctionStats
+{
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> errors{0};
+    LatencyHistogram marshal;
+    LatencyHistogram native;
+    // Async calls only: from submission until a worker starts the call, and
+    // from the end of the call until its result reaches JS.
+    LatencyHistogram queueWait;
+    LatencyHistogram completion;
+
+    void Reset();
+    Napi::Object ToJs(Napi::Env env) const;
+};
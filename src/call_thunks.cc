@@ -0,0 +1,227 @@
+#include "call_thunks.h"
+#include "call_plan.h"
+#include <memory>
+#include <tuple>
+#include <utility>
+
+template <typename T>
+struct ThunkType;
+
+template <>
+struct ThunkType<void>
+{
+    static const ValueType type = TYPE_VOID;
+};
+
+template <>
+struct ThunkType<int32_t>
+{
+    static const ValueType type = TYPE_INT32;
+    static int32_t FromJs(Napi::Value value) { return value.As<Napi::Number>().Int32Value(); }
+    static Napi::Value ToJs(Napi::Env env, int32_t value) { return Napi::Number::New(env, value); }
+};
+
+template <>
+struct ThunkType<uint32_t>
+{
+    static const ValueType type = TYPE_UINT32;
+    static uint32_t FromJs(Napi::Value value) { return value.As<Napi::Number>().Uint32Value(); }
+    static Napi::Value ToJs(Napi::Env env, uint32_t value) { return Napi::Number::New(env, value); }
+};
+
+template <>
+struct ThunkType<double>
+{
+    static const ValueType type = TYPE_DOUBLE;
+    static double FromJs(Napi::Value value) { return value.As<Napi::Number>().DoubleValue(); }
+    static Napi::Value ToJs(Napi::Env env, double value) { return Napi::Number::New(env, value); }
+};
+
+template <>
+struct ThunkType<void *>
+{
+    static const ValueType type = TYPE_POINTER;
+    static void *FromJs(Napi::Value value) { return value.IsExternal() ? value.As<Napi::External<void>>().Data() : nullptr; }
+    static Napi::Value ToJs(Napi::Env env, void *value) { return Napi::External<void>::New(env, value); }
+};
+
+template <>
+struct ThunkType<const char *>
+{
+    static const ValueType type = TYPE_STRING;
+    static Napi::Value ToJs(Napi::Env env, const char *value)
+    {
+        if (!value)
+        {
+            return env.Null();
+        }
+        return Napi::String::New(env, value);
+    }
+};
+
+template <typename T>
+class ThunkArg
+{
+public:
+    explicit ThunkArg(Napi::Value value)
+        : value(value.IsNull() || value.IsUndefined() ? T() : ThunkType<T>::FromJs(value)) {}
+
+    T Get() const { return value; }
+
+private:
+    T value;
+};
+
+// Short strings are encoded into the argument itself, on the caller's stack;
+// longer ones take a single heap allocation of the exact size.
+template <>
+class ThunkArg<const char *>
+{
+public:
+    explicit ThunkArg(Napi::Value value)
+        : isString(value.IsString())
+    {
+        size_t length;
+        if (!isString || TryEncodeUtf8(value.Env(), value, storage, sizeof(storage), length))
+        {
+            return;
+        }
+        heap.reset(new char[length + 1]);
+        if (napi_get_value_string_utf8(value.Env(), value, heap.get(), length + 1, &length) != napi_ok)
+        {
+            throw Napi::Error::New(value.Env());
+        }
+    }
+
+    const char *Get() const { return heap ? heap.get() : isString ? storage : nullptr; }
+
+private:
+    bool isString;
+    char storage[256];
+    std::unique_ptr<char[]> heap;
+};
+
+template <typename R>
+struct ThunkReturn
+{
+    template <typename Func, typename... Args>
+    static Napi::Value Call(Napi::Env env, Func func, Args... args)
+    {
+        return ThunkType<R>::ToJs(env, func(args...));
+    }
+};
+
+template <>
+struct ThunkReturn<void>
+{
+    template <typename Func, typename... Args>
+    static Napi::Value Call(Napi::Env env, Func func, Args... args)
+    {
+        func(args...);
+        return env.Undefined();
+    }
+};
+
+template <typename R, typename... Args>
+struct Thunk
+{
+    static Napi::Value Call(const Napi::CallbackInfo &info, void *funcPtr)
+    {
+        return CallWith(info, funcPtr, std::index_sequence_for<Args...>());
+    }
+
+    template <size_t... I>
+    static Napi::Value CallWith(const Napi::CallbackInfo &info, void *funcPtr, std::index_sequence<I...>)
+    {
+        std::tuple<ThunkArg<Args>...> args{info[I]...};
+        (void)args;
+        return ThunkReturn<R>::Call(info.Env(), reinterpret_cast<R (*)(Args...)>(funcPtr), std::get<I>(args).Get()...);
+    }
+};
+
+const size_t kMaxThunkArity = 4;
+
+struct ThunkEntry
+{
+    ValueType returnType;
+    size_t arity;
+    ValueType paramTypes[kMaxThunkArity];
+    CallThunk thunk;
+};
+
+template <typename R, typename... Args>
+static ThunkEntry MakeThunk()
+{
+    static_assert(sizeof...(Args) <= kMaxThunkArity, "thunk arity is limited to kMaxThunkArity");
+    const ValueType types[] = {ThunkType<Args>::type..., TYPE_VOID};
+
+    ThunkEntry entry = {ThunkType<R>::type, sizeof...(Args), {}, &Thunk<R, Args...>::Call};
+    for (size_t i = 0; i < sizeof...(Args); i++)
+    {
+        entry.paramTypes[i] = types[i];
+    }
+    return entry;
+}
+
+typedef const char *CString;
+
+// Every return type with no parameter or with one parameter of any type.
+#define THUNKS_FOR_RETURN(R)          \
+    MakeThunk<R>(),                   \
+        MakeThunk<R, int32_t>(),      \
+        MakeThunk<R, uint32_t>(),     \
+        MakeThunk<R, double>(),       \
+        MakeThunk<R, CString>(),      \
+        MakeThunk<R, void *>()
+
+static const ThunkEntry kThunks[] = {
+    THUNKS_FOR_RETURN(void),
+    THUNKS_FOR_RETURN(int32_t),
+    THUNKS_FOR_RETURN(uint32_t),
+    THUNKS_FOR_RETURN(double),
+    THUNKS_FOR_RETURN(CString),
+    THUNKS_FOR_RETURN(void *),
+    // Shapes used by the printer and SAT vendor libraries.
+    MakeThunk<int32_t, int32_t, int32_t>(),
+    MakeThunk<int32_t, CString, int32_t>(),
+    MakeThunk<int32_t, int32_t, CString>(),
+    MakeThunk<int32_t, CString, CString>(),
+    MakeThunk<int32_t, void *, int32_t>(),
+    MakeThunk<double, double, double>(),
+    MakeThunk<CString, int32_t, int32_t>(),
+    MakeThunk<CString, int32_t, CString>(),
+    MakeThunk<int32_t, int32_t, CString, CString>(),
+    MakeThunk<CString, int32_t, CString, CString>(),
+    MakeThunk<CString, int32_t, CString, int32_t>(),
+    MakeThunk<int32_t, CString, int32_t, int32_t, int32_t>(),
+    MakeThunk<int32_t, int32_t, CString, CString, int32_t>(),
+    MakeThunk<CString, int32_t, CString, CString, CString>(),
+};
+
+CallThunk FindCallThunk(const CallPlan &plan)
+{
+    if (!IsNativeAbi(plan.abi) || plan.paramTypes.size() > kMaxThunkArity)
+    {
+        return nullptr;
+    }
+
+    for (const ThunkEntry &entry : kThunks)
+    {
+        if (entry.returnType != plan.returnType || entry.arity != plan.paramTypes.size())
+        {
+            continue;
+        }
+
+        bool matches = true;
+        for (size_t i = 0; i < entry.arity && matches; i++)
+        {
+            matches = entry.paramTypes[i] == plan.paramTypes[i];
+        }
+        if (matches)
+        {
+            return entry.thunk;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+struct CallPlan;
+
+// Reads the JS arguments and calls the target with native types directly,
+// bypassing the frame and the call engine.
+typedef Napi::Value (*CallThunk)(const Napi::CallbackInfo &info, void *funcPtr);
+
+CallThunk FindCallThunk(const CallPlan &plan);
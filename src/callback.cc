@@ -0,0 +1,410 @@
+#include "callback.h"
+#include "callback_trampoline.h"
+#include "call_plan.h"
+#include "struct_type.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+static const napi_type_tag kCallbackTag = {0x6666692d6c696273ULL, 0x63616c6c6261636bULL};
+
+// A native thread waiting for the result of a non-void callback.
+struct CallbackWaiter
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;
+    uint64_t result = 0;
+
+    // Notifies under the lock: the waiter lives on the native thread's stack
+    // and is gone as soon as it sees finished.
+    void Finish(uint64_t value)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = value;
+        finished = true;
+        done.notify_one();
+    }
+};
+
+// A call from another thread. Strings and structs behind pointers are
+// copied, since the native caller may reuse them once it returns.
+struct CallbackInvocation
+{
+    std::vector<uint64_t> values;
+    std::vector<std::string> copies;
+    CallbackWaiter *waiter;
+};
+
+struct CallbackState
+{
+    static void Deliver(Napi::Env env, Napi::Function, CallbackState *state, void *);
+
+    typedef Napi::TypedThreadSafeFunction<CallbackState, void, &CallbackState::Deliver> Deliveries;
+
+    napi_env env;
+    std::thread::id mainThread;
+    size_t slot;
+    void *address;
+    ValueType returnType;
+    std::vector<ValueType> paramTypes;
+    std::vector<std::shared_ptr<const StructLayout>> paramLayouts;
+    CallbackLayout layout;
+    Napi::FunctionReference function;
+    Deliveries deliveries;
+
+    std::mutex mutex;
+    std::vector<CallbackInvocation> queue;
+    bool scheduled = false;
+    bool closed = false;
+
+    uint64_t Call(Napi::Env env, uint64_t *values, bool copied);
+    uint64_t Post(std::vector<uint64_t> values);
+};
+
+static std::mutex slotMutex;
+static std::shared_ptr<CallbackState> slots[kCallbackSlots];
+
+uint64_t CallbackState::Call(Napi::Env env, uint64_t *values, bool copied)
+{
+    Napi::HandleScope scope(env);
+    uint64_t result = 0;
+
+    if (function.IsEmpty())
+    {
+        return result;
+    }
+
+    // Nothing can unwind through the native caller, so an exception is
+    // reported as uncaught and the caller gets a zero result.
+    try
+    {
+        std::vector<napi_value> args;
+        args.reserve(paramTypes.size());
+        for (size_t i = 0; i < paramTypes.size(); i++)
+        {
+            if (copied && paramTypes[i] == TYPE_STRUCT_PTR)
+            {
+                args.push_back(StructToJs(env, *paramLayouts[i], reinterpret_cast<void *>(values[i]), true));
+            }
+            else
+            {
+                args.push_back(ConvertNativeToJsValue(env, &values[i], paramTypes[i], paramLayouts[i].get()));
+            }
+        }
+
+        Napi::Value value = function.Call(args);
+        if (returnType != TYPE_VOID)
+        {
+            ConvertJsValueToScalar(value, returnType, &result);
+        }
+    }
+    catch (const Napi::Error &e)
+    {
+        napi_fatal_exception(env, e.Value());
+    }
+    return result;
+}
+
+static void CopyPointee(ValueType type, const StructLayout *layout, uint64_t value, std::string &copy)
+{
+    const char *data = reinterpret_cast<const char *>(static_cast<uintptr_t>(value));
+    if (!data)
+    {
+        return;
+    }
+
+    switch (type)
+    {
+    case TYPE_STRING:
+        copy.assign(data, strlen(data) + 1);
+        break;
+    case TYPE_WSTRING:
+    {
+        size_t length = std::char_traits<char16_t>::length(reinterpret_cast<const char16_t *>(data)) + 1;
+        copy.assign(data, length * sizeof(char16_t));
+        break;
+    }
+    case TYPE_STRUCT_PTR:
+        copy.assign(data, layout->size);
+        break;
+    default:
+        break;
+    }
+}
+
+// Queues the call for the JS thread. Only the first call since the last
+// delivery wakes the loop; a void callback returns at once, others block
+// until JS has produced the result.
+uint64_t CallbackState::Post(std::vector<uint64_t> values)
+{
+    CallbackWaiter waiter;
+    CallbackInvocation invocation;
+    invocation.copies.resize(values.size());
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        CopyPointee(paramTypes[i], paramLayouts[i].get(), values[i], invocation.copies[i]);
+    }
+    invocation.values = std::move(values);
+    invocation.waiter = returnType == TYPE_VOID ? nullptr : &waiter;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closed)
+        {
+            return 0;
+        }
+        if (!scheduled)
+        {
+            if (deliveries.NonBlockingCall() != napi_ok)
+            {
+                return 0;
+            }
+            scheduled = true;
+        }
+        queue.push_back(std::move(invocation));
+    }
+
+    if (returnType == TYPE_VOID)
+    {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(waiter.mutex);
+    waiter.done.wait(lock, [&waiter]
+                     { return waiter.finished; });
+    return waiter.result;
+}
+
+void CallbackState::Deliver(Napi::Env env, Napi::Function, CallbackState *state, void *)
+{
+    std::vector<CallbackInvocation> batch;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        batch.swap(state->queue);
+        state->scheduled = false;
+    }
+
+    for (CallbackInvocation &invocation : batch)
+    {
+        uint64_t result = 0;
+        if (env != nullptr)
+        {
+            for (size_t i = 0; i < invocation.copies.size(); i++)
+            {
+                if (!invocation.copies[i].empty())
+                {
+                    invocation.values[i] = reinterpret_cast<uintptr_t>(invocation.copies[i].data());
+                }
+            }
+            result = state->Call(env, invocation.values.data(), true);
+        }
+        if (invocation.waiter)
+        {
+            invocation.waiter->Finish(result);
+        }
+    }
+}
+
+uint64_t DispatchCallback(size_t slot, const CallbackWords &words)
+{
+    std::shared_ptr<CallbackState> state = std::atomic_load(&slots[slot]);
+    if (!state)
+    {
+        return 0;
+    }
+
+    std::vector<uint64_t> values(state->paramTypes.size(), 0);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        ReadCallbackArg(words, state->layout.args[i], &values[i], GetTypeSize(state->paramTypes[i]));
+    }
+
+    if (std::this_thread::get_id() == state->mainThread)
+    {
+        return state->Call(Napi::Env(state->env), values.data(), false);
+    }
+    return state->Post(std::move(values));
+}
+
+static bool IsCallbackReturnType(ValueType type)
+{
+    return type == TYPE_VOID || (type != TYPE_STRUCT && type != TYPE_STRUCT_PTR && !IsStringType(type) &&
+                                 !IsBufferType(type) && !IsArrayType(type));
+}
+
+void CallbackWrapper::Init(Napi::Env env, Napi::Object exports)
+{
+    Napi::Function func = DefineClass(env, "Callback", {InstanceAccessor("address", &CallbackWrapper::Address, nullptr),
+                                                        InstanceMethod("close", &CallbackWrapper::Close)});
+    exports.Set("Callback", func);
+}
+
+void *CallbackWrapper::AddressOf(Napi::Value value)
+{
+    if (value.IsNull() || value.IsUndefined())
+    {
+        return nullptr;
+    }
+    if (value.IsExternal())
+    {
+        return value.As<Napi::External<void>>().Data();
+    }
+
+    bool tagged = false;
+    if (!value.IsObject() || napi_check_object_type_tag(value.Env(), value, &kCallbackTag, &tagged) != napi_ok || !tagged)
+    {
+        throw Napi::TypeError::New(value.Env(), "Expected a Callback");
+    }
+
+    CallbackWrapper *wrapper = Unwrap(value.As<Napi::Object>());
+    if (!wrapper->state)
+    {
+        throw Napi::Error::New(value.Env(), "Callback is closed");
+    }
+    return wrapper->state->address;
+}
+
+// new Callback(returnType, paramTypes, fn, { abi })
+CallbackWrapper::CallbackWrapper(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<CallbackWrapper>(info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsArray() || !info[2].IsFunction())
+    {
+        throw Napi::TypeError::New(env, "Expected return type, parameter types and a function");
+    }
+
+    auto callback = std::make_shared<CallbackState>();
+    callback->env = env;
+    callback->mainThread = std::this_thread::get_id();
+
+    std::string returnStr = info[0].As<Napi::String>().Utf8Value();
+    std::shared_ptr<const StructLayout> returnLayout;
+    callback->returnType = ResolveType(env, returnStr, returnLayout);
+    if (!IsCallbackReturnType(callback->returnType))
+    {
+        throw Napi::TypeError::New(env, "Unsupported callback return type: " + returnStr);
+    }
+
+    Napi::Array paramArray = info[1].As<Napi::Array>();
+    std::vector<ArgLoad> loads;
+    for (uint32_t i = 0; i < paramArray.Length(); i++)
+    {
+        std::string typeStr = paramArray.Get(i).As<Napi::String>().Utf8Value();
+        std::shared_ptr<const StructLayout> layout;
+        ValueType type = ResolveType(env, typeStr, layout);
+        if (type == TYPE_VOID || type == TYPE_STRUCT)
+        {
+            throw Napi::TypeError::New(env, "Unsupported callback parameter type: " + typeStr);
+        }
+        callback->paramTypes.push_back(type);
+        callback->paramLayouts.push_back(layout);
+        loads.push_back(GetArgLoad(type));
+    }
+
+    CallAbi abi = ABI_DEFAULT;
+    if (info.Length() > 3 && info[3].IsObject())
+    {
+        Napi::Object options = info[3].As<Napi::Object>();
+        if (options.Has("abi"))
+        {
+            abi = GetAbiFromString(options.Get("abi").As<Napi::String>().Utf8Value(), env);
+        }
+    }
+
+    try
+    {
+        LayoutCallback(loads, callback->layout);
+    }
+    catch (const std::exception &e)
+    {
+        throw Napi::Error::New(env, e.what());
+    }
+
+    callback->function = Napi::Persistent(info[2].As<Napi::Function>());
+    callback->deliveries = CallbackState::Deliveries::New(
+        env, "ffi-libraries:callback", 0, 1, callback.get(),
+        [](Napi::Env, std::shared_ptr<CallbackState> *holder, CallbackState *)
+        { delete holder; },
+        new std::shared_ptr<CallbackState>(callback));
+    callback->deliveries.Unref(env);
+
+    {
+        std::lock_guard<std::mutex> lock(slotMutex);
+        size_t slot = 0;
+        while (slot < kCallbackSlots && std::atomic_load(&slots[slot]))
+        {
+            slot++;
+        }
+        if (slot == kCallbackSlots)
+        {
+            callback->deliveries.Release();
+            throw Napi::Error::New(env, "All " + std::to_string(kCallbackSlots) +
+                                            " callback slots are in use; close callbacks that are no longer needed");
+        }
+
+        callback->slot = slot;
+        callback->address = GetCallbackTrampoline(slot, abi, GetReturnClass(callback->returnType), callback->layout);
+        std::atomic_store(&slots[slot], callback);
+    }
+    state = callback;
+
+    if (napi_type_tag_object(env, info.This(), &kCallbackTag) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+}
+
+CallbackWrapper::~CallbackWrapper()
+{
+    Release();
+}
+
+Napi::Value CallbackWrapper::Address(const Napi::CallbackInfo &info)
+{
+    if (!state)
+    {
+        return info.Env().Null();
+    }
+    return Napi::External<void>::New(info.Env(), state->address);
+}
+
+Napi::Value CallbackWrapper::Close(const Napi::CallbackInfo &info)
+{
+    Release();
+    return info.Env().Undefined();
+}
+
+// Frees the slot so native calls through the old pointer return zero, and
+// wakes threads still waiting for a result.
+void CallbackWrapper::Release()
+{
+    if (!state)
+    {
+        return;
+    }
+
+    std::atomic_store(&slots[state->slot], std::shared_ptr<CallbackState>());
+
+    std::vector<CallbackInvocation> pending;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->closed = true;
+        pending.swap(state->queue);
+    }
+    for (CallbackInvocation &invocation : pending)
+    {
+        if (invocation.waiter)
+        {
+            invocation.waiter->Finish(0);
+        }
+    }
+
+    state->function.Reset();
+    state->deliveries.Release();
+    state.reset();
+}
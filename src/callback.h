@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common.h"
+#include <memory>
+
+struct CallbackState;
+
+// A JS function behind a native function pointer of a given signature.
+// Native code calling it on the JS thread runs the function directly; calls
+// from other threads are queued and delivered in batches, one event-loop
+// wakeup for everything that arrived since the last delivery.
+class CallbackWrapper : public Napi::ObjectWrap<CallbackWrapper>
+{
+public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    static void *AddressOf(Napi::Value value);
+    CallbackWrapper(const Napi::CallbackInfo &info);
+    ~CallbackWrapper();
+
+private:
+    std::shared_ptr<CallbackState> state;
+
+    Napi::Value Address(const Napi::CallbackInfo &info);
+    Napi::Value Close(const Napi::CallbackInfo &info);
+    void Release();
+};
@@ -0,0 +1,262 @@
+#include "callback_trampoline.h"
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(FFI_ENGINE_X86)
+#if defined(_MSC_VER)
+#define FFI_CDECL __cdecl
+#define FFI_STDCALL __stdcall
+#else
+#define FFI_CDECL __attribute__((cdecl))
+#define FFI_STDCALL __attribute__((stdcall))
+#endif
+#endif
+
+template <size_t>
+using GprWord = uint64_t;
+template <size_t>
+using FprWord = double;
+template <size_t>
+using StackWord = uintptr_t;
+
+static inline uint64_t ToBits(uint64_t value)
+{
+    return value;
+}
+
+static inline uint64_t ToBits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+template <typename R>
+static inline R FromBits(uint64_t bits)
+{
+    R value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+#if defined(FFI_ENGINE_SPLIT_REGISTERS)
+// Declaring every argument register plus the first stack words captures
+// any signature that fits: a float arrives in the low bits of its double.
+template <size_t Slot, typename G, typename F, typename S>
+struct SplitTrampoline;
+
+template <size_t Slot, size_t... G, size_t... F, size_t... S>
+struct SplitTrampoline<Slot, std::index_sequence<G...>, std::index_sequence<F...>, std::index_sequence<S...>>
+{
+    template <typename R>
+    static R Entry(GprWord<G>... gpr, FprWord<F>... fpr, StackWord<S>... stack)
+    {
+        CallbackWords words = {{gpr...}, {ToBits(fpr)...}, {stack...}};
+        return FromBits<R>(DispatchCallback(Slot, words));
+    }
+};
+
+template <size_t Slot>
+using Trampoline = SplitTrampoline<Slot, std::make_index_sequence<kIntRegisters>,
+                                   std::make_index_sequence<kFloatRegisters>,
+                                   std::make_index_sequence<kCallbackStackWords>>;
+
+template <typename R, size_t... Slot>
+static void *FindEntry(size_t slot, const CallbackLayout &, std::index_sequence<Slot...>)
+{
+    static void *const table[] = {reinterpret_cast<void *>(&Trampoline<Slot>::template Entry<R>)...};
+    return table[slot];
+}
+#elif defined(FFI_ENGINE_WIN64)
+// Win64 assigns registers by position, so the entry has to declare which of
+// the first four parameters are floating point; one variant per mask.
+template <unsigned Mask, size_t I>
+using PositionalWord = typename std::conditional<I < 4 && ((Mask >> I) & 1), double, uint64_t>::type;
+
+template <size_t Slot, unsigned Mask, typename S>
+struct PositionalTrampoline;
+
+template <size_t Slot, unsigned Mask, size_t... S>
+struct PositionalTrampoline<Slot, Mask, std::index_sequence<S...>>
+{
+    template <typename R>
+    static R Entry(PositionalWord<Mask, S>... args)
+    {
+        CallbackWords words = {{0}, {0}, {ToBits(args)...}};
+        return FromBits<R>(DispatchCallback(Slot, words));
+    }
+};
+
+template <typename R, size_t Slot, size_t... Mask>
+static void *FindMaskEntry(unsigned mask, std::index_sequence<Mask...>)
+{
+    static void *const table[] = {reinterpret_cast<void *>(
+        &PositionalTrampoline<Slot, Mask, std::make_index_sequence<kCallbackStackWords>>::template Entry<R>)...};
+    return table[mask];
+}
+
+template <typename R, size_t... Slot>
+static void *FindEntry(size_t slot, const CallbackLayout &layout, std::index_sequence<Slot...>)
+{
+    typedef void *(*Finder)(unsigned, std::make_index_sequence<16>);
+    static const Finder table[] = {&FindMaskEntry<R, Slot>...};
+    return table[slot](layout.floatMask, std::make_index_sequence<16>());
+}
+#elif defined(FFI_ENGINE_X86)
+// Everything arrives on the stack. cdecl entries read a fixed number of
+// words; stdcall entries must declare the exact size they pop.
+template <size_t Slot, typename S>
+struct StackTrampoline;
+
+template <size_t Slot, size_t... S>
+struct StackTrampoline<Slot, std::index_sequence<S...>>
+{
+    template <typename R>
+    static R FFI_CDECL Entry(StackWord<S>... args)
+    {
+        CallbackWords words = {{0}, {0}, {args...}};
+        return FromBits<R>(DispatchCallback(Slot, words));
+    }
+
+    template <typename R>
+    static R FFI_STDCALL EntryStd(StackWord<S>... args)
+    {
+        CallbackWords words = {{0}, {0}, {args...}};
+        return FromBits<R>(DispatchCallback(Slot, words));
+    }
+};
+
+template <typename R, size_t... Slot>
+static void *FindEntry(size_t slot, const CallbackLayout &, std::index_sequence<Slot...>)
+{
+    static void *const table[] = {reinterpret_cast<void *>(
+        &StackTrampoline<Slot, std::make_index_sequence<kCallbackStackWords>>::template Entry<R>)...};
+    return table[slot];
+}
+
+template <typename R, size_t Slot, size_t... Words>
+static void *FindDepthEntry(size_t words, std::index_sequence<Words...>)
+{
+    static void *const table[] = {reinterpret_cast<void *>(
+        &StackTrampoline<Slot, std::make_index_sequence<Words>>::template EntryStd<R>)...};
+    return table[words];
+}
+
+template <typename R, size_t... Slot>
+static void *FindStdcallEntry(size_t slot, const CallbackLayout &layout, std::index_sequence<Slot...>)
+{
+    typedef void *(*Finder)(size_t, std::make_index_sequence<kCallbackStackWords + 1>);
+    static const Finder table[] = {&FindDepthEntry<R, Slot>...};
+    return table[slot](layout.stackWords, std::make_index_sequence<kCallbackStackWords + 1>());
+}
+#endif
+
+static inline bool IsFloatLoad(ArgLoad load)
+{
+    return load == LOAD_F32 || load == LOAD_F64;
+}
+
+void LayoutCallback(const std::vector<ArgLoad> &loads, CallbackLayout &layout)
+{
+    size_t gpr = 0;
+    size_t fpr = 0;
+    size_t words = 0;
+
+    layout.args.clear();
+    layout.floatMask = 0;
+
+    for (size_t i = 0; i < loads.size(); i++)
+    {
+        CallbackArg arg;
+#if defined(FFI_ENGINE_SPLIT_REGISTERS)
+        if (IsFloatLoad(loads[i]) && fpr < kFloatRegisters)
+        {
+            arg.bank = BANK_FPR;
+            arg.index = static_cast<uint16_t>(fpr++);
+        }
+        else if (!IsFloatLoad(loads[i]) && gpr < kIntRegisters)
+        {
+            arg.bank = BANK_GPR;
+            arg.index = static_cast<uint16_t>(gpr++);
+        }
+        else
+        {
+            arg.bank = BANK_STACK;
+            arg.index = static_cast<uint16_t>(words++ * kStackWordSize);
+        }
+#elif defined(FFI_ENGINE_WIN64)
+        (void)gpr;
+        (void)fpr;
+        if (i < 4 && IsFloatLoad(loads[i]))
+        {
+            layout.floatMask |= 1u << i;
+        }
+        arg.bank = BANK_STACK;
+        arg.index = static_cast<uint16_t>(words++ * kStackWordSize);
+#else
+        (void)gpr;
+        (void)fpr;
+        arg.bank = BANK_STACK;
+        arg.index = static_cast<uint16_t>(words * kStackWordSize);
+        words += loads[i] == LOAD_I64 || loads[i] == LOAD_F64 ? 2 : 1;
+#endif
+        layout.args.push_back(arg);
+    }
+
+    if (words > kCallbackStackWords)
+    {
+        throw std::runtime_error("Callback signature needs " + std::to_string(words) +
+                                 " stack words, the limit is " + std::to_string(kCallbackStackWords));
+    }
+    layout.stackWords = words;
+}
+
+// Copies the low bytes of the word, which is where a narrower value sits on
+// every supported (little-endian) target.
+void ReadCallbackArg(const CallbackWords &words, const CallbackArg &arg, void *slot, size_t size)
+{
+    switch (arg.bank)
+    {
+    case BANK_GPR:
+        memcpy(slot, &words.gpr[arg.index], size);
+        break;
+    case BANK_FPR:
+        memcpy(slot, &words.fpr[arg.index], size);
+        break;
+    default:
+        memcpy(slot, reinterpret_cast<const uint8_t *>(words.stack) + arg.index, size);
+        break;
+    }
+}
+
+void *GetCallbackTrampoline(size_t slot, CallAbi abi, ReturnClass returnClass, const CallbackLayout &layout)
+{
+    typedef std::make_index_sequence<kCallbackSlots> AllSlots;
+#if defined(FFI_ENGINE_X86)
+    if (abi == ABI_STDCALL)
+    {
+        switch (returnClass)
+        {
+        case RETURN_FLOAT:
+            return FindStdcallEntry<float>(slot, layout, AllSlots());
+        case RETURN_DOUBLE:
+            return FindStdcallEntry<double>(slot, layout, AllSlots());
+        default:
+            return FindStdcallEntry<uint64_t>(slot, layout, AllSlots());
+        }
+    }
+#else
+    (void)abi;
+#endif
+    switch (returnClass)
+    {
+    case RETURN_FLOAT:
+        return FindEntry<float>(slot, layout, AllSlots());
+    case RETURN_DOUBLE:
+        return FindEntry<double>(slot, layout, AllSlots());
+    default:
+        return FindEntry<uint64_t>(slot, layout, AllSlots());
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "call_engine.h"
+
+// Native entry points handed out for JS callbacks. Each is an ordinary
+// function generated from a template; the slot index baked into it is the
+// only state it carries, so a fixed pool of slots serves every callback.
+const size_t kCallbackSlots = 64;
+const size_t kCallbackStackWords = 16;
+
+// Raw argument words as a trampoline received them.
+struct CallbackWords
+{
+    uint64_t gpr[kIntRegisters ? kIntRegisters : 1];
+    uint64_t fpr[kFloatRegisters ? kFloatRegisters : 1];
+    uintptr_t stack[kCallbackStackWords];
+};
+
+// Where one parameter arrives: a register index, or a byte offset into the
+// captured stack words.
+struct CallbackArg
+{
+    uint8_t bank;
+    uint16_t index;
+};
+
+struct CallbackLayout
+{
+    std::vector<CallbackArg> args;
+    // Win64 parameters among the first four that arrive in XMM registers.
+    unsigned floatMask = 0;
+    size_t stackWords = 0;
+};
+
+// Computes where each parameter arrives; throws when the signature needs
+// more stack than a trampoline captures.
+void LayoutCallback(const std::vector<ArgLoad> &loads, CallbackLayout &layout);
+void ReadCallbackArg(const CallbackWords &words, const CallbackArg &arg, void *slot, size_t size);
+void *GetCallbackTrampoline(size_t slot, CallAbi abi, ReturnClass returnClass, const CallbackLayout &layout);
+
+// Implemented by the callback registry: runs the callback bound to slot and
+// returns its result as raw register bits (a float in the low 32 bits).
+uint64_t DispatchCallback(size_t slot, const CallbackWords &words);
@@ -5,6 +5,9 @@
 #include <vector>
 #include <map>
 
+class CallFrame;
+struct StructLayout;
+
 enum ValueType
 {
     TYPE_VOID,
@@ -20,10 +23,48 @@ enum ValueType
     TYPE_DOUBLE,
     TYPE_STRING,
     TYPE_POINTER,
-    TYPE_BOOL
+    TYPE_BOOL,
+    TYPE_BUFFER,
+    TYPE_UINT8_PTR,
+    TYPE_INT32_PTR,
+    TYPE_DOUBLE_PTR,
+    TYPE_WSTRING,
+    TYPE_STRUCT,
+    TYPE_STRUCT_PTR,
+    TYPE_CALLBACK,
+    // Arrays of numbers, written 'double[]' and passed by address; see
+    // array_type.h.
+    TYPE_INT8_ARRAY,
+    TYPE_UINT8_ARRAY,
+    TYPE_INT16_ARRAY,
+    TYPE_UINT16_ARRAY,
+    TYPE_INT32_ARRAY,
+    TYPE_UINT32_ARRAY,
+    TYPE_INT64_ARRAY,
+    TYPE_UINT64_ARRAY,
+    TYPE_FLOAT_ARRAY,
+    TYPE_DOUBLE_ARRAY
+};
+
+// How a returned C string is handed to JavaScript.
+enum StringReturn
+{
+    STRING_UTF8,
+    STRING_LATIN1,
+    STRING_BUFFER,
+    STRING_EXTERNAL
 };
 
 ValueType GetTypeFromString(const std::string &typeStr, Napi::Env env);
-void *ConvertJsValueToNative(Napi::Value value, ValueType type, std::vector<void *> &allocations);
-Napi::Value ConvertNativeToJsValue(Napi::Env env, void *data, ValueType type);
-void *CallNativeFunction(void *funcPtr, ValueType returnType, const std::vector<void *> &args);
\ No newline at end of file
+size_t GetTypeSize(ValueType type);
+size_t GetTypeAlignment(ValueType type);
+bool IsBufferType(ValueType type);
+bool IsStringType(ValueType type);
+bool IsArrayType(ValueType type);
+ValueType GetArrayElementType(ValueType type);
+bool TryEncodeUtf8(napi_env env, napi_value value, char *buffer, size_t capacity, size_t &length);
+StringReturn GetStringReturnFromString(const std::string &modeStr, Napi::Env env);
+void ConvertJsValueToScalar(Napi::Value value, ValueType type, void *slot);
+void ConvertJsValueToNative(Napi::Value value, ValueType type, void *slot, CallFrame &frame,
+                            const StructLayout *layout = nullptr);
+Napi::Value ConvertNativeToJsValue(Napi::Env env, void *data, ValueType type, const StructLayout *layout = nullptr);
\ No newline at end of file
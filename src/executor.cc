@@ -0,0 +1,195 @@
+#include "executor.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Shared by the Executor, its worker threads and the thread-safe function.
+// While a worker or an environment shuts down, the thread-safe function can
+// be finalized before the Executor is destroyed; closed then keeps both from
+// touching it again.
+struct Executor::State
+{
+    static void Complete(Napi::Env env, Napi::Function, State *state, NativeTask *task);
+
+    typedef Napi::TypedThreadSafeFunction<State, NativeTask, &State::Complete> Completions;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    // A task, or a job posted by Post().
+    struct Entry
+    {
+        NativeTask *task;
+        std::function<void()> job;
+    };
+
+    std::deque<Entry> queue;
+    size_t maxQueue;
+    size_t pending = 0;
+    bool stopping = false;
+    bool closed = false;
+    Completions completions;
+
+    void Run()
+    {
+        for (;;)
+        {
+            Entry entry;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this]
+                           { return stopping || !queue.empty(); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                entry = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            if (entry.job)
+            {
+                entry.job();
+                continue;
+            }
+
+            entry.task->Execute();
+
+            // Fails only while the environment is torn down; the task holds
+            // JS references and cannot be released from this thread.
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!closed)
+            {
+                completions.NonBlockingCall(entry.task);
+            }
+        }
+    }
+};
+
+void Executor::State::Complete(Napi::Env env, Napi::Function, State *state, NativeTask *task)
+{
+    std::unique_ptr<NativeTask> owned(task);
+    if (env == nullptr)
+    {
+        return;
+    }
+
+    if (--state->pending == 0)
+    {
+        state->completions.Unref(env);
+    }
+    owned->Complete(env);
+}
+
+Executor::Executor(Napi::Env env, size_t threads, size_t maxQueue)
+    : state(std::make_shared<State>())
+{
+    state->maxQueue = maxQueue;
+    state->completions = State::Completions::New(
+        env, "ffi-libraries:executor", 0, 1, state.get(),
+        [](Napi::Env, std::shared_ptr<State> *held, State *state)
+        {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->closed = true;
+            }
+            delete held;
+        },
+        new std::shared_ptr<State>(state));
+    state->completions.Unref(env);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        std::shared_ptr<State> shared = state;
+        workers.emplace_back([shared]
+                             { shared->Run(); });
+    }
+}
+
+// Queued tasks still run before the threads exit. Joining blocks until the
+// native call in progress returns.
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+    }
+    state->ready.notify_all();
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    if (!state->closed)
+    {
+        state->completions.Release();
+    }
+}
+
+void Executor::Submit(Napi::Env env, std::unique_ptr<NativeTask> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->closed)
+        {
+            throw Napi::Error::New(env, "Library executor is closed");
+        }
+        if (state->maxQueue && state->queue.size() >= state->maxQueue)
+        {
+            Napi::Error error = Napi::Error::New(env, "Library executor queue is full");
+            error.Set("code", Napi::String::New(env, "ERR_FFI_QUEUE_FULL"));
+            throw error;
+        }
+        state->queue.push_back(State::Entry{task.release(), nullptr});
+    }
+    state->ready.notify_one();
+
+    if (state->pending++ == 0)
+    {
+        state->completions.Ref(env);
+    }
+}
+
+bool Executor::Post(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->stopping)
+        {
+            return false;
+        }
+        state->queue.push_back(State::Entry{nullptr, std::move(job)});
+    }
+    state->ready.notify_one();
+    return true;
+}
+
+// More threads than any device DLL can use; beyond it a typo would start
+// threads until the process runs out.
+static const size_t kMaxThreads = 256;
+
+std::shared_ptr<Executor> Executor::FromOptions(Napi::Env env, Napi::Value options)
+{
+    if (!options.IsObject())
+    {
+        return nullptr;
+    }
+
+    Napi::Object config = options.As<Napi::Object>();
+    size_t threads = 1;
+    size_t maxQueue = 256;
+
+    if (config.Has("threads"))
+    {
+        threads = config.Get("threads").As<Napi::Number>().Uint32Value();
+    }
+    if (config.Has("maxQueue"))
+    {
+        maxQueue = config.Get("maxQueue").As<Napi::Number>().Uint32Value();
+    }
+    if (threads < 1 || threads > kMaxThreads)
+    {
+        throw Napi::RangeError::New(env, "Executor threads must be between 1 and " + std::to_string(kMaxThreads));
+    }
+
+    return std::make_shared<Executor>(env, threads, maxQueue);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "native_task.h"
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Dedicated worker threads for one library, used instead of the libuv
+// threadpool so slow device calls cannot starve fs, crypto or dns. Tasks
+// wait in a bounded queue and complete back on the JS thread through a
+// thread-safe function.
+class Executor
+{
+public:
+    Executor(Napi::Env env, size_t threads, size_t maxQueue);
+    ~Executor();
+
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    void Submit(Napi::Env env, std::unique_ptr<NativeTask> task);
+    // Queues job behind the tasks already submitted, from any thread. Nothing
+    // completes on the JS thread. False once the executor is stopping.
+    bool Post(std::function<void()> job);
+
+    static std::shared_ptr<Executor> FromOptions(Napi::Env env, Napi::Value options);
+
+private:
+    struct State;
+
+    std::shared_ptr<State> state;
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,19 @@
+// External strings are still an experimental Node-API. This file is the
+// only one built with NAPI_EXPERIMENTAL so the rest of the addon keeps the
+// stable ABI; older headers fall back to a copy.
+#define NAPI_EXPERIMENTAL
+#define NODE_API_EXPERIMENTAL_BASIC_ENV_OPT_OUT
+#include <js_native_api.h>
+
+napi_status CreateExternalLatin1(napi_env env, char *str, size_t length, napi_finalize finalize, void *hint, napi_value *result)
+{
+#ifdef NODE_API_EXPERIMENTAL_HAS_EXTERNAL_STRINGS
+    // When V8 copies the data anyway the finalizer has already run.
+    bool copied;
+    return node_api_create_external_string_latin1(env, str, length, finalize, hint, result, &copied);
+#else
+    napi_status status = napi_create_string_latin1(env, str, length, result);
+    finalize(env, str, hint);
+    return status;
+#endif
+}
@@ -1,9 +1,21 @@
 #include <napi.h>
+#include "addon_data.h"
 #include "library_wrapper.h"
+#include "pipeline.h"
+#include "struct_type.h"
+#include "callback.h"
+#include "native_memory.h"
 
 Napi::Object InitModule(Napi::Env env, Napi::Object exports)
 {
-    return LibraryWrapper::Init(env, exports);
+    env.SetInstanceData(new AddonData());
+
+    LibraryWrapper::Init(env, exports);
+    PipelineWrapper::Init(env);
+    InitStructs(env, exports);
+    CallbackWrapper::Init(env, exports);
+    InitMemory(env, exports);
+    return exports;
 }
 
-NODE_API_MODULE(NODE_GYP_MODULE_NAME, InitModule)
\ No newline at end of file
+NODE_API_MODULE(NODE_GYP_MODULE_NAME, InitModule)
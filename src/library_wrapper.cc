@@ -1,30 +1,97 @@
 #include "library_wrapper.h"
 #include "common.h"
+#include "call_frame.h"
+#include "batch_call.h"
+#include "call_sharing.h"
+#include "addon_data.h"
+#include "executor.h"
+#include "shared_library.h"
+#include "variadic_signatures.h"
+#include "watcher.h"
+#include <cmath>
+#include <cstdint>
 #include <iostream>
-#include <windows.h>
 
 struct LibraryWrapper::Impl
 {
-    void *libraryHandle;
-    std::map<std::string, FunctionInfo> functions;
+    std::shared_ptr<SharedLibrary> library;
+    std::map<std::string, std::shared_ptr<const CallPlan>> functions;
+    std::shared_ptr<Executor> executor;
+    std::shared_ptr<bool> closed = std::make_shared<bool>(false);
+    // The functions map of a lazy library holds null plans until first use.
+    bool lazy = false;
+    bool stats = false;
+    // Constructor arguments, read by lazy accessors and by token().
+    std::string path;
+    Napi::ObjectReference definitions;
+    Napi::Reference<Napi::Value> options;
+};
+
+// Arguments bound by fn.prepare(), converted once. Each call copies their
+// slots; the strings, structs and buffers they point to live as long as
+// this object, which the prepared functions and their pending calls share.
+struct BoundArguments
+{
+    BoundArguments(std::shared_ptr<const CallPlan> plan, size_t count)
+        : plan(std::move(plan)), frame(*this->plan), count(count)
+    {
+        frame.RetainValues();
+    }
+
+    std::shared_ptr<const CallPlan> plan;
+    CallFrame frame;
+    size_t count;
 };
 
 Napi::Object LibraryWrapper::Init(Napi::Env env, Napi::Object exports)
 {
     Napi::HandleScope scope(env);
 
-    Napi::Function func = DefineClass(env, "Library", {InstanceMethod("close", &LibraryWrapper::Close)});
+    Napi::Function func = DefineClass(env, "Library", {InstanceMethod("close", &LibraryWrapper::Close),
+                                                       InstanceMethod("pipeline", &LibraryWrapper::Pipeline),
+                                                       InstanceMethod("stats", &LibraryWrapper::Stats),
+                                                       InstanceMethod("token", &LibraryWrapper::Token)});
 
-    Napi::FunctionReference *constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
-    env.SetInstanceData(constructor);
+    env.GetInstanceData<AddonData>()->libraryConstructor = Napi::Persistent(func);
 
     exports.Set("Library", func);
     return exports;
 }
 
+// loader: { binding: 'lazy' | 'now', scope: 'local' | 'global' }, the
+// dlopen flags. Windows accepts and ignores them.
+static ModuleOptions GetModuleOptions(Napi::Env env, Napi::Value value)
+{
+    ModuleOptions options;
+    if (!value.IsObject())
+    {
+        return options;
+    }
+
+    Napi::Object loader = value.As<Napi::Object>();
+    if (loader.Has("binding"))
+    {
+        std::string binding = loader.Get("binding").As<Napi::String>().Utf8Value();
+        if (binding != "lazy" && binding != "now")
+        {
+            throw Napi::TypeError::New(env, "loader.binding must be 'lazy' or 'now'");
+        }
+        options.bindNow = binding == "now";
+    }
+    if (loader.Has("scope"))
+    {
+        std::string scope = loader.Get("scope").As<Napi::String>().Utf8Value();
+        if (scope != "local" && scope != "global")
+        {
+            throw Napi::TypeError::New(env, "loader.scope must be 'local' or 'global'");
+        }
+        options.global = scope == "global";
+    }
+    return options;
+}
+
 LibraryWrapper::LibraryWrapper(const Napi::CallbackInfo &info)
-    : Napi::ObjectWrap<LibraryWrapper>(info)
+    : Napi::ObjectWrap<LibraryWrapper>(info), impl(new Impl())
 {
     Napi::Env env = info.Env();
 
@@ -34,196 +101,652 @@ LibraryWrapper::LibraryWrapper(const Napi::CallbackInfo &info)
         return;
     }
 
-    std::string libraryPath = info[0].As<Napi::String>().Utf8Value();
-    void *handle = LoadLibraryA(libraryPath.c_str());
+    ModuleOptions moduleOptions;
+    if (info.Length() > 2 && info[2].IsObject())
+    {
+        impl->options = Napi::Persistent(info[2]);
+        Napi::Object options = info[2].As<Napi::Object>();
+        moduleOptions = GetModuleOptions(env, options.Get("loader"));
+        impl->executor = Executor::FromOptions(env, options.Get("executor"));
+        impl->lazy = options.Get("lazy").ToBoolean().Value();
+        impl->stats = options.Get("stats").ToBoolean().Value();
+    }
+
+    impl->path = info[0].As<Napi::String>().Utf8Value();
+    std::string error;
+    impl->library = SharedLibrary::Open(impl->path, moduleOptions, error);
 
-    if (!handle)
+    if (!impl->library)
     {
-        Napi::Error::New(env, "Failed to load library: " + libraryPath).ThrowAsJavaScriptException();
+        Napi::Error::New(env, "Failed to load library: " + impl->path + ": " + error).ThrowAsJavaScriptException();
         return;
     }
 
     Napi::Object funcDefs = info[1].As<Napi::Object>();
+    impl->definitions = Napi::Persistent(funcDefs);
     Napi::Array funcNames = funcDefs.GetPropertyNames();
     Napi::Object thisObj = info.This().As<Napi::Object>();
 
-    for (uint32_t i = 0; i < funcNames.Length(); i++)
+    if (!impl->lazy)
     {
-        Napi::Value funcName = funcNames[i];
-        Napi::Value funcDef = funcDefs.Get(funcName);
+        for (uint32_t i = 0; i < funcNames.Length(); i++)
+        {
+            std::string name = funcNames.Get(i).As<Napi::String>().Utf8Value();
+            Napi::Value funcDef = funcDefs.Get(name);
+            if (!IsFunctionDefinition(funcDef))
+                continue;
+
+            std::shared_ptr<const CallPlan> plan = GetCallPlan(env, ParseFunctionInfo(env, name, funcDef.As<Napi::Array>()));
+            impl->functions[name] = plan;
+            thisObj.Set(name, CreateFunctionObject(env, plan));
+        }
+        return;
+    }
 
-        if (!funcDef.IsArray())
+    // Lazy libraries only record the names; an accessor per function
+    // resolves the symbol and builds the wrappers on first access.
+    std::vector<napi_property_descriptor> accessors;
+    accessors.reserve(funcNames.Length());
+    for (uint32_t i = 0; i < funcNames.Length(); i++)
+    {
+        std::string name = funcNames.Get(i).As<Napi::String>().Utf8Value();
+        if (!IsFunctionDefinition(funcDefs.Get(name)))
             continue;
 
-        Napi::Array def = funcDef.As<Napi::Array>();
-        if (def.Length() != 2)
-            continue;
+        auto entry = impl->functions.emplace(name, nullptr).first;
+        napi_property_descriptor accessor = {};
+        accessor.utf8name = entry->first.c_str();
+        accessor.getter = &LibraryWrapper::MaterializeFunction;
+        accessor.attributes = static_cast<napi_property_attributes>(napi_enumerable | napi_configurable);
+        accessor.data = const_cast<std::string *>(&entry->first);
+        accessors.push_back(accessor);
+    }
+
+    if (napi_define_properties(env, thisObj, accessors.size(), accessors.data()) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+}
+
+bool LibraryWrapper::IsFunctionDefinition(Napi::Value funcDef)
+{
+    if (!funcDef.IsArray())
+        return false;
+
+    uint32_t length = funcDef.As<Napi::Array>().Length();
+    return length == 2 || length == 3;
+}
 
-        std::string returnType = def.Get(uint32_t(0)).As<Napi::String>().Utf8Value();
+FunctionInfo LibraryWrapper::ParseFunctionInfo(Napi::Env env, const std::string &name, Napi::Array def)
+{
+    if (!impl->library)
+    {
+        throw Napi::Error::New(env, "Library is closed");
+    }
 
-        Napi::Array paramTypes = def.Get(uint32_t(1)).As<Napi::Array>();
-        std::vector<std::string> paramTypeList;
+    FunctionInfo funcInfo;
+    funcInfo.library = impl->library;
+    funcInfo.stats = impl->stats;
+    funcInfo.returnType = def.Get(uint32_t(0)).As<Napi::String>().Utf8Value();
 
-        for (uint32_t j = 0; j < paramTypes.Length(); j++)
+    Napi::Array paramTypes = def.Get(uint32_t(1)).As<Napi::Array>();
+    for (uint32_t j = 0; j < paramTypes.Length(); j++)
+    {
+        std::string typeStr = paramTypes.Get(j).As<Napi::String>().Utf8Value();
+        if (typeStr == "...")
         {
-            paramTypeList.push_back(paramTypes.Get(j).As<Napi::String>().Utf8Value());
+            if (j + 1 != paramTypes.Length())
+            {
+                throw Napi::TypeError::New(env, "'...' must be the last parameter type: " + name);
+            }
+            funcInfo.variadic = true;
+            break;
         }
+        funcInfo.paramTypes.push_back(typeStr);
+    }
 
-        void *funcPtr = GetProcAddress(static_cast<HMODULE>(handle), funcName.As<Napi::String>().Utf8Value().c_str());
+    funcInfo.ptr = impl->library->Symbol(name);
+    if (!funcInfo.ptr)
+    {
+        throw Napi::Error::New(env, "Failed to get function pointer: " + name);
+    }
 
-        if (!funcPtr)
+    if (def.Length() == 3 && def.Get(uint32_t(2)).IsObject())
+    {
+        Napi::Object options = def.Get(uint32_t(2)).As<Napi::Object>();
+        if (options.Has("abi"))
         {
-            Napi::Error::New(env, "Failed to get function pointer: " + funcName.As<Napi::String>().Utf8Value()).ThrowAsJavaScriptException();
-            continue;
+            funcInfo.abi = GetAbiFromString(options.Get("abi").As<Napi::String>().Utf8Value(), env);
+        }
+        if (options.Has("returnString"))
+        {
+            funcInfo.stringReturn = GetStringReturnFromString(options.Get("returnString").As<Napi::String>().Utf8Value(), env);
         }
+        if (options.Has("coalesce"))
+        {
+            funcInfo.coalesce = options.Get("coalesce").ToBoolean().Value();
+        }
+        if (options.Has("cacheTtlMs"))
+        {
+            funcInfo.cacheTtlMs = options.Get("cacheTtlMs").As<Napi::Number>().DoubleValue();
+            if (!(funcInfo.cacheTtlMs >= 0))
+            {
+                throw Napi::RangeError::New(env, "cacheTtlMs must be a non-negative number");
+            }
+        }
+        if (options.Has("returnLength"))
+        {
+            // A fixed count, or { param: index } naming the argument that
+            // carries it.
+            Napi::Value length = options.Get("returnLength");
+            bool byParam = length.IsObject();
+            double value = byParam ? length.As<Napi::Object>().Get("param").ToNumber().DoubleValue()
+                                   : length.ToNumber().DoubleValue();
+            if (!(value >= (byParam ? 0 : 1) && value <= UINT32_MAX && value == std::floor(value)))
+            {
+                throw Napi::RangeError::New(env, "returnLength must be a positive integer or { param: index }");
+            }
+            if (byParam)
+            {
+                funcInfo.returnLengthParam = static_cast<int>(value);
+            }
+            else
+            {
+                funcInfo.returnLength = value;
+            }
+        }
+        if (options.Has("free"))
+        {
+            std::string freeName = options.Get("free").As<Napi::String>().Utf8Value();
+            funcInfo.freePtr = impl->library->Symbol(freeName);
+            if (!funcInfo.freePtr)
+            {
+                throw Napi::Error::New(env, "Failed to get function pointer: " + freeName);
+            }
+        }
+    }
+
+    return funcInfo;
+}
 
-        FunctionInfo funcInfo;
-        funcInfo.ptr = funcPtr;
-        funcInfo.returnType = returnType;
-        funcInfo.paramTypes = paramTypeList;
+Napi::Object LibraryWrapper::CreateFunctionObject(Napi::Env env, std::shared_ptr<const CallPlan> plan)
+{
+    ClosedFlag closed = impl->closed;
+    Napi::Function funcObj = CreateSyncWrapper(env, plan, closed);
+
+    std::shared_ptr<CallSharing> sharing;
+    if (plan->coalesce || plan->cacheTtlNs)
+    {
+        sharing = std::make_shared<CallSharing>(*plan);
+    }
+    funcObj.Set("async", CreateAsyncWrapper(env, plan, closed, impl->executor, false, nullptr, sharing));
+    funcObj.Set("promise", CreateAsyncWrapper(env, plan, closed, impl->executor, true, nullptr, sharing));
 
-        Napi::Object funcObj = Napi::Object::New(env);
+    std::shared_ptr<Executor> executor = impl->executor;
+    funcObj.Set("prepare", Napi::Function::New(env, [plan, closed, executor, sharing](const Napi::CallbackInfo &cbInfo) -> Napi::Value
+                                               { return CreatePreparedFunction(cbInfo, plan, closed, executor, sharing); }));
 
-        Napi::Function syncFunc = CreateSyncWrapper(env, funcInfo);
-        funcObj = syncFunc;
+    Napi::Function batchFunc = CreateBatchWrapper(env, plan, closed);
+    batchFunc.Set("async", CreateBatchAsyncWrapper(env, plan, closed, impl->executor, false));
+    batchFunc.Set("promise", CreateBatchAsyncWrapper(env, plan, closed, impl->executor, true));
+    funcObj.Set("batch", batchFunc);
 
-        funcObj.Set("async", CreateAsyncWrapper(env, funcInfo));
+    funcObj.Set("watch", CreateWatchWrapper(env, plan, closed, impl->executor));
 
-        thisObj.Set(funcName, funcObj);
+    return funcObj;
+}
+
+// Compiles a lazily declared function the first time it is needed.
+std::shared_ptr<const CallPlan> LibraryWrapper::ResolveFunction(Napi::Env env, const std::string &name)
+{
+    auto it = impl->functions.find(name);
+    if (it == impl->functions.end())
+    {
+        return nullptr;
+    }
+    if (!it->second)
+    {
+        Napi::Value def = impl->definitions.Value().Get(name);
+        if (!IsFunctionDefinition(def))
+        {
+            throw Napi::TypeError::New(env, "Invalid function definition: " + name);
+        }
+        it->second = GetCallPlan(env, ParseFunctionInfo(env, name, def.As<Napi::Array>()));
+    }
+    return it->second;
+}
+
+// Getter installed for each function of a lazy library. It replaces itself
+// with a plain data property, so later accesses cost nothing extra.
+napi_value LibraryWrapper::MaterializeFunction(napi_env env, napi_callback_info cbinfo)
+{
+    Napi::CallbackInfo info(env, cbinfo);
+    try
+    {
+        const std::string &name = *static_cast<const std::string *>(info.Data());
+        Napi::Object thisObj = info.This().As<Napi::Object>();
+        LibraryWrapper *wrapper = Unwrap(thisObj);
+
+        Napi::Object funcObj = wrapper->CreateFunctionObject(info.Env(), wrapper->ResolveFunction(info.Env(), name));
+
+        napi_property_descriptor value = {};
+        value.utf8name = name.c_str();
+        value.value = funcObj;
+        value.attributes = napi_default_jsproperty;
+        if (napi_define_properties(env, thisObj, 1, &value) != napi_ok)
+        {
+            throw Napi::Error::New(info.Env());
+        }
+        return funcObj;
+    }
+    catch (const Napi::Error &e)
+    {
+        e.ThrowAsJavaScriptException();
+        return nullptr;
     }
 }
 
 LibraryWrapper::~LibraryWrapper()
 {
-    if (impl)
+    delete impl;
+}
+
+std::shared_ptr<const CallPlan> LibraryWrapper::FindFunction(Napi::Env env, const std::string &name)
+{
+    CheckOpen(env, impl->closed);
+    return ResolveFunction(env, name);
+}
+
+std::shared_ptr<Executor> LibraryWrapper::GetExecutor() const
+{
+    return impl->executor;
+}
+
+ClosedFlag LibraryWrapper::GetClosedFlag() const
+{
+    return impl->closed;
+}
+
+Napi::Value LibraryWrapper::Pipeline(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    Napi::Value options = info.Length() > 0 ? info[0] : env.Undefined();
+    return env.GetInstanceData<AddonData>()->pipelineConstructor.New({info.This(), options});
+}
+
+// stats({ reset }) returns the counters of every compiled function by name;
+// functions of a lazy library appear once they have been used.
+Napi::Value LibraryWrapper::Stats(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    bool reset = info.Length() > 0 && info[0].IsObject() && info[0].As<Napi::Object>().Get("reset").ToBoolean().Value();
+
+    Napi::Object result = Napi::Object::New(env);
+    for (const auto &entry : impl->functions)
     {
-        if (impl->libraryHandle)
+        if (!entry.second || !entry.second->stats)
+            continue;
+
+        result.Set(entry.first, entry.second->stats->ToJs(env));
+        if (reset)
         {
-            FreeLibrary(static_cast<HMODULE>(impl->libraryHandle));
+            entry.second->stats->Reset();
         }
-        delete impl;
     }
+    return result;
 }
 
-Napi::Value LibraryWrapper::Close(const Napi::CallbackInfo &info)
+// token() describes the library as plain data that can be posted to a
+// worker thread. Library.attach(token) there finds the module already
+// loaded and the signatures already compiled.
+Napi::Value LibraryWrapper::Token(const Napi::CallbackInfo &info)
 {
-    if (impl && impl->libraryHandle)
+    Napi::Env env = info.Env();
+    if (!impl->library)
+    {
+        throw Napi::Error::New(env, "Library is closed");
+    }
+
+    Napi::Object definitions = Napi::Object::New(env);
+    for (const auto &entry : impl->functions)
     {
-        FreeLibrary(static_cast<HMODULE>(impl->libraryHandle));
-        impl->libraryHandle = nullptr;
+        definitions.Set(entry.first, impl->definitions.Value().Get(entry.first));
     }
+
+    Napi::Object token = Napi::Object::New(env);
+    token.Set("path", impl->path);
+    token.Set("definitions", definitions);
+    token.Set("options", impl->options.IsEmpty() ? env.Undefined() : impl->options.Value());
+    return token;
+}
+
+Napi::Value LibraryWrapper::Close(const Napi::CallbackInfo &info)
+{
+    // The module stays loaded while other Library objects use it, and while
+    // calls already made still run or hold strings it must free.
+    *impl->closed = true;
+    impl->library.reset();
     return info.Env().Undefined();
 }
 
-Napi::Function LibraryWrapper::CreateSyncWrapper(Napi::Env env, const FunctionInfo &funcInfo)
+Napi::Function LibraryWrapper::CreateSyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed)
 {
-    return Napi::Function::New(env, [funcInfo](const Napi::CallbackInfo &cbInfo) -> Napi::Value
+    if (plan->variadic)
+    {
+        return Napi::Function::New(env, [plan, closed](const Napi::CallbackInfo &cbInfo) -> Napi::Value {
+            CheckOpen(cbInfo.Env(), closed);
+            return CallThroughFrame(cbInfo, plan, nullptr); });
+    }
+    if (plan->stats)
+    {
+        return CreateMeasuredSyncWrapper(env, plan, closed);
+    }
+
+    return Napi::Function::New(env, [plan, closed](const Napi::CallbackInfo &cbInfo) -> Napi::Value
                                {
         Napi::Env cbEnv = cbInfo.Env();
-        std::vector<void*> args;
-        std::vector<void*> allocations;
+        CheckOpen(cbEnv, closed);
 
         try {
-            for (size_t i = 0; i < cbInfo.Length() && i < funcInfo.paramTypes.size(); i++) {
-                ValueType type = GetTypeFromString(funcInfo.paramTypes[i], cbEnv);
-                void* arg = ConvertJsValueToNative(cbInfo[i], type, allocations);
-                args.push_back(arg);
+            if (plan->thunk) {
+                return plan->thunk(cbInfo, plan->ptr);
             }
 
-            ValueType returnType = GetTypeFromString(funcInfo.returnType, cbEnv);
-            void* result = CallNativeFunction(funcInfo.ptr, returnType, args);
-
-            Napi::Value jsResult = ConvertNativeToJsValue(cbEnv, result, returnType);
+            CallFrame frame(*plan);
+            frame.MarshalArguments(cbInfo, 0, cbInfo.Length());
+            frame.Invoke();
+            return frame.ResultToJs(cbEnv);
+        } catch (const Napi::Error&) {
+            throw;
+        } catch (const std::exception& e) {
+            throw Napi::Error::New(cbEnv, e.what());
+        } });
+}
 
-            for (void* ptr : allocations) {
-                delete[] static_cast<uint8_t*>(ptr);
-            }
-            if (result && returnType != TYPE_VOID) {
-                delete[] static_cast<uint8_t*>(result);
-            }
+// The sync wrapper of a library with statistics. Kept apart so the other
+// libraries do not even test for them.
+Napi::Function LibraryWrapper::CreateMeasuredSyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed)
+{
+    return Napi::Function::New(env, [plan, closed](const Napi::CallbackInfo &cbInfo) -> Napi::Value
+                               {
+        Napi::Env cbEnv = cbInfo.Env();
+        CheckOpen(cbEnv, closed);
+        FunctionStats &stats = *plan->stats;
+        stats.calls.fetch_add(1, std::memory_order_relaxed);
 
-            return jsResult;
+        try {
+            uint64_t start = MonotonicNs();
+            CallFrame frame(*plan);
+            frame.MarshalArguments(cbInfo, 0, cbInfo.Length());
+            uint64_t marshalled = MonotonicNs();
+            frame.Invoke();
+            stats.native.Record(MonotonicNs() - marshalled);
+            stats.marshal.Record(marshalled - start);
+            return frame.ResultToJs(cbEnv);
+        } catch (const Napi::Error&) {
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
+            throw;
         } catch (const std::exception& e) {
-            for (void* ptr : allocations) {
-                delete[] static_cast<uint8_t*>(ptr);
-            }
+            stats.errors.fetch_add(1, std::memory_order_relaxed);
             throw Napi::Error::New(cbEnv, e.what());
         } });
 }
 
-Napi::Function LibraryWrapper::CreateAsyncWrapper(Napi::Env env, const FunctionInfo &funcInfo)
+// The plan for argc arguments starting at parameter firstParam: the declared
+// one, or the plan of their shape when they include variadic extras.
+static std::shared_ptr<const CallPlan> SelectCallPlan(const std::shared_ptr<const CallPlan> &plan, const Napi::CallbackInfo &info,
+                                                      size_t argc, size_t firstParam)
+{
+    size_t fixed = plan->paramTypes.size() - firstParam;
+    if (!plan->variadic || argc <= fixed)
+    {
+        return plan;
+    }
+    return plan->variadic->Get(info, fixed, argc - fixed);
+}
+
+// Sync calls of prepared and variadic functions, which neither thunks nor
+// the plain wrapper handle. bound may be null.
+Napi::Value LibraryWrapper::CallThroughFrame(const Napi::CallbackInfo &cbInfo, const std::shared_ptr<const CallPlan> &declared,
+                                             const BoundArguments *bound)
 {
-    return Napi::Function::New(env, [funcInfo](const Napi::CallbackInfo &cbInfo) -> Napi::Value
+    Napi::Env cbEnv = cbInfo.Env();
+    FunctionStats *stats = declared->stats.get();
+    if (stats)
+    {
+        stats->calls.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    try
+    {
+        uint64_t start = stats ? MonotonicNs() : 0;
+        size_t firstParam = bound ? bound->count : 0;
+        std::shared_ptr<const CallPlan> plan = SelectCallPlan(declared, cbInfo, cbInfo.Length(), firstParam);
+        CallFrame frame(*plan);
+        if (bound)
+        {
+            frame.CopyArguments(bound->frame, bound->count);
+        }
+        frame.MarshalArguments(cbInfo, 0, cbInfo.Length(), firstParam);
+        if (!stats)
+        {
+            frame.Invoke();
+            return frame.ResultToJs(cbEnv);
+        }
+
+        uint64_t marshalled = MonotonicNs();
+        frame.Invoke();
+        stats->native.Record(MonotonicNs() - marshalled);
+        stats->marshal.Record(marshalled - start);
+        return frame.ResultToJs(cbEnv);
+    }
+    catch (const Napi::Error &)
+    {
+        if (stats)
+        {
+            stats->errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        throw;
+    }
+    catch (const std::exception &e)
+    {
+        if (stats)
+        {
+            stats->errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        throw Napi::Error::New(cbEnv, e.what());
+    }
+}
+
+// fn.prepare(...args) binds the leading parameters. The returned function
+// takes the remaining ones and has its own async and promise variants.
+Napi::Value LibraryWrapper::CreatePreparedFunction(const Napi::CallbackInfo &info, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                                   std::shared_ptr<Executor> executor, std::shared_ptr<CallSharing> sharing)
+{
+    Napi::Env env = info.Env();
+    CheckOpen(env, closed);
+    if (info.Length() > plan->paramTypes.size())
+    {
+        throw Napi::TypeError::New(env, "More arguments bound than the function takes");
+    }
+
+    std::shared_ptr<BoundArguments> bound = std::make_shared<BoundArguments>(plan, info.Length());
+    try
+    {
+        bound->frame.MarshalArguments(info, 0, bound->count);
+    }
+    catch (const Napi::Error &)
+    {
+        throw;
+    }
+    catch (const std::exception &e)
+    {
+        throw Napi::Error::New(env, e.what());
+    }
+
+    Napi::Function funcObj = Napi::Function::New(env, [bound, closed](const Napi::CallbackInfo &cbInfo) -> Napi::Value {
+        CheckOpen(cbInfo.Env(), closed);
+        return CallThroughFrame(cbInfo, bound->plan, bound.get()); });
+
+    funcObj.Set("async", CreateAsyncWrapper(env, plan, closed, executor, false, bound, sharing));
+    funcObj.Set("promise", CreateAsyncWrapper(env, plan, closed, executor, true, bound, sharing));
+    return funcObj;
+}
+
+Napi::Function LibraryWrapper::CreateAsyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                                  std::shared_ptr<Executor> executor, bool promise,
+                                                  std::shared_ptr<const BoundArguments> bound, std::shared_ptr<CallSharing> sharing)
+{
+    return Napi::Function::New(env, [plan, closed, executor, promise, bound, sharing](const Napi::CallbackInfo &cbInfo) -> Napi::Value
                                {
         Napi::Env cbEnv = cbInfo.Env();
-        std::vector<void*> args;
-        std::vector<void*> allocations;
-        
+        CheckOpen(cbEnv, closed);
+
         try {
-            if (cbInfo.Length() < 1 || !cbInfo[cbInfo.Length()-1].IsFunction()) {
-                throw Napi::TypeError::New(cbEnv, "Last argument must be a callback function");
-            }
+            size_t argc = cbInfo.Length();
+            Napi::Value callback = cbEnv.Undefined();
 
-            for (size_t i = 0; i < cbInfo.Length() - 1 && i < funcInfo.paramTypes.size(); i++) {
-                ValueType type = GetTypeFromString(funcInfo.paramTypes[i], cbEnv);
-                void* arg = ConvertJsValueToNative(cbInfo[i], type, allocations);
-                args.push_back(arg);
+            if (!promise) {
+                if (argc < 1 || !cbInfo[argc-1].IsFunction()) {
+                    throw Napi::TypeError::New(cbEnv, "Last argument must be a callback function");
+                }
+                callback = cbInfo[--argc];
             }
 
-            Napi::Function callback = cbInfo[cbInfo.Length()-1].As<Napi::Function>();
-
-            class AsyncWorker : public Napi::AsyncWorker {
+            class CallTask : public NativeTask {
             public:
-                AsyncWorker(Napi::Function& callback, void* funcPtr, 
-                        ValueType returnType, std::vector<void*> args)
-                    : Napi::AsyncWorker(callback), 
-                    funcPtr(funcPtr), returnType(returnType), args(args) {}
+                CallTask(Napi::Env env, Napi::Value callback, std::shared_ptr<const CallPlan> plan,
+                         std::shared_ptr<const BoundArguments> bound)
+                    : NativeTask(env, callback),
+                    plan(std::move(plan)), bound(std::move(bound)), frame(*this->plan) {
+                    frame.RetainValues();
+                }
+
+                void Marshal(const Napi::CallbackInfo& info, size_t argc) {
+                    if (bound) {
+                        frame.CopyArguments(bound->frame, bound->count);
+                        frame.MarshalArguments(info, 0, argc, bound->count);
+                    } else {
+                        frame.MarshalArguments(info, 0, argc);
+                    }
+                }
 
                 void Execute() override {
+                    FunctionStats *stats = plan->stats.get();
+                    uint64_t start = stats ? MonotonicNs() : 0;
+                    if (stats) {
+                        stats->queueWait.Record(start - queuedAt);
+                    }
+
                     try {
-                        result = CallNativeFunction(funcPtr, returnType, args);
+                        frame.Invoke();
+                        if (IsStringType(plan->returnType)) {
+                            frame.OwnResultString();
+                        } else if (IsArrayType(plan->returnType)) {
+                            frame.OwnResultArray();
+                        }
                     } catch (const std::exception& e) {
                         SetError(e.what());
+                        if (stats) {
+                            stats->errors.fetch_add(1, std::memory_order_relaxed);
+                        }
+                    }
+
+                    if (stats) {
+                        finishedAt = MonotonicNs();
+                        stats->native.Record(finishedAt - start);
                     }
                 }
 
-                void OnOK() override {
-                    Napi::HandleScope scope(Env());
-                    Callback().Call({Env().Null(), ConvertNativeToJsValue(Env(), result, returnType)});
-                    
-                    if (result && returnType != TYPE_VOID) {
-                        delete[] static_cast<uint8_t*>(result);
+                void OnOK(Napi::Env env) override {
+                    if (plan->stats) {
+                        plan->stats->completion.Record(MonotonicNs() - finishedAt);
                     }
-                    
-                    for (void* ptr : args) {
-                        delete[] static_cast<uint8_t*>(ptr);
+                    // A conversion error reaches OnError, which also fails
+                    // the calls sharing this one.
+                    Napi::Value value = frame.ResultToJs(env);
+                    if (sharing) {
+                        sharing->Complete(env, sharingKey, value);
+                    }
+                    Resolve(env, value);
+                }
+
+                void OnError(Napi::Env env, const Napi::Error& e) override {
+                    if (sharing) {
+                        sharing->Fail(env, sharingKey, e);
                     }
+                    Reject(env, e);
                 }
 
-                void OnError(const Napi::Error& e) override {
-                    Napi::HandleScope scope(Env());
-                    Callback().Call({e.Value(), Env().Undefined()});
-                    
-                    for (void* ptr : args) {
-                        delete[] static_cast<uint8_t*>(ptr);
+                // Identical calls made before this one settles may attach to
+                // it; false when the call was settled that way instead.
+                bool Share(Napi::Env env, std::shared_ptr<CallSharing> calls, Napi::Value callback, Napi::Value& result) {
+                    std::string key = CallSharing::Key(*plan, frame);
+                    if (calls->TryShare(env, key, callback, result)) {
+                        return false;
                     }
+                    sharing = std::move(calls);
+                    sharingKey = std::move(key);
+                    return true;
                 }
 
+                std::shared_ptr<CallSharing> sharing;
+                std::string sharingKey;
+                uint64_t queuedAt = 0;
+
             private:
-                void* funcPtr;
-                ValueType returnType;
-                std::vector<void*> args;
-                void* result = nullptr;
+                std::shared_ptr<const CallPlan> plan;
+                std::shared_ptr<const BoundArguments> bound;
+                CallFrame frame;
+                uint64_t finishedAt = 0;
             };
 
-            AsyncWorker* worker = new AsyncWorker(callback, funcInfo.ptr, GetTypeFromString(funcInfo.returnType, cbEnv), std::move(args));
-            worker->Queue();
+            FunctionStats *stats = plan->stats.get();
+            uint64_t start = 0;
+            if (stats) {
+                stats->calls.fetch_add(1, std::memory_order_relaxed);
+                start = MonotonicNs();
+            }
 
-            return cbEnv.Undefined();
-        } catch (const std::exception& e) {
-            for (void* ptr : allocations) {
-                delete[] static_cast<uint8_t*>(ptr);
+            std::shared_ptr<const CallPlan> callPlan = SelectCallPlan(plan, cbInfo, argc, bound ? bound->count : 0);
+            std::unique_ptr<CallTask> task(new CallTask(cbEnv, callback, callPlan, bound));
+            try {
+                task->Marshal(cbInfo, argc);
+            } catch (...) {
+                if (stats) {
+                    stats->errors.fetch_add(1, std::memory_order_relaxed);
+                }
+                throw;
+            }
+            Napi::Value result;
+            if (sharing && !task->Share(cbEnv, sharing, callback, result)) {
+                return result;
+            }
+
+            result = task->Promise(cbEnv);
+            if (stats) {
+                task->queuedAt = MonotonicNs();
+                stats->marshal.Record(task->queuedAt - start);
+            }
+            if (!task->sharing) {
+                ScheduleTask(cbEnv, executor, std::move(task));
+                return result;
+            }
+
+            // Later identical calls would otherwise wait for a call that was
+            // never queued.
+            std::shared_ptr<CallSharing> calls = task->sharing;
+            std::string key = task->sharingKey;
+            try {
+                ScheduleTask(cbEnv, executor, std::move(task));
+            } catch (const Napi::Error& e) {
+                calls->Fail(cbEnv, key, e);
+                throw;
             }
+            return result;
+        } catch (const Napi::Error&) {
+            throw;
+        } catch (const std::exception& e) {
             throw Napi::Error::New(cbEnv, e.what());
         } });
-}
\ No newline at end of file
+}
@@ -4,13 +4,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "call_plan.h"
 
-struct FunctionInfo
-{
-    void *ptr;
-    std::string returnType;
-    std::vector<std::string> paramTypes;
-};
+class Executor;
+class CallSharing;
+struct BoundArguments;
 
 class LibraryWrapper : public Napi::ObjectWrap<LibraryWrapper>
 {
@@ -19,11 +17,32 @@ public:
     LibraryWrapper(const Napi::CallbackInfo &info);
     ~LibraryWrapper();
 
+    std::shared_ptr<const CallPlan> FindFunction(Napi::Env env, const std::string &name);
+    std::shared_ptr<Executor> GetExecutor() const;
+    ClosedFlag GetClosedFlag() const;
+
 private:
     struct Impl;
     Impl *impl;
 
     Napi::Value Close(const Napi::CallbackInfo &info);
-    Napi::Function CreateSyncWrapper(Napi::Env env, const FunctionInfo &funcInfo);
-    Napi::Function CreateAsyncWrapper(Napi::Env env, const FunctionInfo &funcInfo);
+    Napi::Value Pipeline(const Napi::CallbackInfo &info);
+    Napi::Value Stats(const Napi::CallbackInfo &info);
+    Napi::Value Token(const Napi::CallbackInfo &info);
+
+    static bool IsFunctionDefinition(Napi::Value funcDef);
+    static napi_value MaterializeFunction(napi_env env, napi_callback_info cbinfo);
+    FunctionInfo ParseFunctionInfo(Napi::Env env, const std::string &name, Napi::Array def);
+    std::shared_ptr<const CallPlan> ResolveFunction(Napi::Env env, const std::string &name);
+    Napi::Object CreateFunctionObject(Napi::Env env, std::shared_ptr<const CallPlan> plan);
+    static Napi::Value CallThroughFrame(const Napi::CallbackInfo &cbInfo, const std::shared_ptr<const CallPlan> &declared,
+                                        const BoundArguments *bound);
+    static Napi::Function CreateSyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed);
+    static Napi::Function CreateMeasuredSyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed);
+    static Napi::Function CreateAsyncWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                             std::shared_ptr<Executor> executor, bool promise,
+                                             std::shared_ptr<const BoundArguments> bound = nullptr,
+                                             std::shared_ptr<CallSharing> sharing = nullptr);
+    static Napi::Value CreatePreparedFunction(const Napi::CallbackInfo &info, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                              std::shared_ptr<Executor> executor, std::shared_ptr<CallSharing> sharing);
 };
\ No newline at end of file
@@ -0,0 +1,187 @@
+#include "memory_pool.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+#include <vector>
+
+static const size_t kMinClassSize = 16;
+static const size_t kClassCount = 9; // 16 .. 4096 bytes
+static const size_t kSlabBlocks = 64;
+// Empty slabs kept per class; the rest go back to malloc.
+static const size_t kMaxEmptySlabs = 4;
+
+// kSlabBlocks blocks of one class in a single malloc'd run; bit i of used is
+// set while block i is allocated. Class sizes are powers of two from 16, so
+// every block keeps malloc's alignment.
+struct Slab
+{
+    char *base;
+    size_t sizeClass;
+    uint64_t used;
+};
+
+static std::mutex poolMutex;
+// By base address, to find the slab a pointer falls in.
+static std::map<uintptr_t, Slab> slabs;
+// Slabs of each class with at least one free block.
+static std::vector<Slab *> partialSlabs[kClassCount];
+static size_t emptySlabs[kClassCount];
+// Blocks above kMaxPooledSize come straight from malloc.
+static std::unordered_set<void *> largeBlocks;
+
+static size_t ClassOf(size_t size)
+{
+    size_t sizeClass = 0;
+    size_t classSize = kMinClassSize;
+    while (classSize < size)
+    {
+        classSize <<= 1;
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+static size_t LowestClearBit(uint64_t bits)
+{
+    size_t index = 0;
+    while (bits & 1)
+    {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+}
+
+static void *AllocateLarge(size_t size)
+{
+    void *block = calloc(1, size);
+    if (!block)
+    {
+        throw std::bad_alloc();
+    }
+    try
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        largeBlocks.insert(block);
+    }
+    catch (...)
+    {
+        free(block);
+        throw;
+    }
+    return block;
+}
+
+// Called with poolMutex held.
+static Slab *AddSlab(size_t sizeClass)
+{
+    char *base = static_cast<char *>(malloc(kSlabBlocks * (kMinClassSize << sizeClass)));
+    if (!base)
+    {
+        throw std::bad_alloc();
+    }
+    try
+    {
+        Slab &slab = slabs[reinterpret_cast<uintptr_t>(base)];
+        slab = Slab{base, sizeClass, 0};
+        partialSlabs[sizeClass].push_back(&slab);
+        emptySlabs[sizeClass]++;
+        return &slab;
+    }
+    catch (...)
+    {
+        slabs.erase(reinterpret_cast<uintptr_t>(base));
+        free(base);
+        throw;
+    }
+}
+
+void *PoolAllocate(size_t size)
+{
+    if (size > kMaxPooledSize)
+    {
+        return AllocateLarge(size);
+    }
+
+    size_t sizeClass = ClassOf(size);
+    char *block;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        std::vector<Slab *> &partial = partialSlabs[sizeClass];
+        Slab *slab = partial.empty() ? AddSlab(sizeClass) : partial.back();
+
+        if (slab->used == 0)
+        {
+            emptySlabs[sizeClass]--;
+        }
+        size_t index = LowestClearBit(slab->used);
+        slab->used |= uint64_t(1) << index;
+        if (slab->used == ~uint64_t(0))
+        {
+            partial.pop_back();
+        }
+        block = slab->base + index * (kMinClassSize << sizeClass);
+    }
+
+    memset(block, 0, size);
+    return block;
+}
+
+bool PoolFree(void *ptr)
+{
+    uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+    char *slabBase = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        auto it = slabs.upper_bound(address);
+        if (it != slabs.begin())
+        {
+            Slab &slab = (--it)->second;
+            size_t blockSize = kMinClassSize << slab.sizeClass;
+            size_t offset = address - it->first;
+            if (offset < kSlabBlocks * blockSize)
+            {
+                uint64_t bit = uint64_t(1) << (offset / blockSize);
+                if (offset % blockSize || !(slab.used & bit))
+                {
+                    return false;
+                }
+
+                std::vector<Slab *> &partial = partialSlabs[slab.sizeClass];
+                if (slab.used == ~uint64_t(0))
+                {
+                    partial.push_back(&slab);
+                }
+                slab.used &= ~bit;
+                if (slab.used != 0 || ++emptySlabs[slab.sizeClass] <= kMaxEmptySlabs)
+                {
+                    return true;
+                }
+
+                emptySlabs[slab.sizeClass]--;
+                for (auto entry = partial.begin(); entry != partial.end(); ++entry)
+                {
+                    if (*entry == &slab)
+                    {
+                        partial.erase(entry);
+                        break;
+                    }
+                }
+                slabBase = slab.base;
+                slabs.erase(it);
+            }
+        }
+
+        if (!slabBase && !largeBlocks.erase(ptr))
+        {
+            return false;
+        }
+    }
+
+    free(slabBase ? slabBase : ptr);
+    return true;
+}
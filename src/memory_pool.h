@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// Zeroed native blocks for memory.alloc(). Sizes up to kMaxPooledSize come
+// from per-size-class slabs of 64 blocks, so scratch space allocated and
+// freed on every call is recycled instead of going back to malloc. PoolFree
+// finds the slab by address and checks its bitmap of live blocks, so other
+// pointers are rejected without reading memory around them. Larger blocks
+// come from malloc and are tracked by address.
+const size_t kMaxPooledSize = 4096;
+
+void *PoolAllocate(size_t size);
+// False when ptr is not a live block of the pool.
+bool PoolFree(void *ptr);
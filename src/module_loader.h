@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+// How dlopen binds and exports a module's symbols. Windows resolves imports
+// at load time and has no global namespace, so both are ignored there.
+struct ModuleOptions
+{
+    bool bindNow = false; // RTLD_NOW instead of RTLD_LAZY
+    bool global = false;  // RTLD_GLOBAL instead of RTLD_LOCAL
+};
+
+// Platform loader: module_loader_win.cc or module_loader_posix.cc, chosen
+// by binding.gyp.
+void *LoadModule(const std::string &path, const ModuleOptions &options, std::string &error);
+void *FindModuleSymbol(void *handle, const std::string &name);
+void UnloadModule(void *handle);
+std::string NormalizeModulePath(const std::string &path);
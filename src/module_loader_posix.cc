@@ -0,0 +1,38 @@
+#include "module_loader.h"
+#include <climits>
+#include <cstdlib>
+#include <dlfcn.h>
+
+void *LoadModule(const std::string &path, const ModuleOptions &options, std::string &error)
+{
+    int flags = (options.bindNow ? RTLD_NOW : RTLD_LAZY) | (options.global ? RTLD_GLOBAL : RTLD_LOCAL);
+    void *handle = dlopen(path.c_str(), flags);
+    if (!handle)
+    {
+        const char *message = dlerror();
+        error = message ? message : "unknown error";
+    }
+    return handle;
+}
+
+void *FindModuleSymbol(void *handle, const std::string &name)
+{
+    return dlsym(handle, name.c_str());
+}
+
+void UnloadModule(void *handle)
+{
+    dlclose(handle);
+}
+
+// A bare name is searched for by dlopen, so only paths are resolved.
+std::string NormalizeModulePath(const std::string &path)
+{
+    if (path.find('/') == std::string::npos)
+    {
+        return path;
+    }
+
+    char buffer[PATH_MAX];
+    return realpath(path.c_str(), buffer) ? std::string(buffer) : path;
+}
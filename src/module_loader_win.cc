@@ -0,0 +1,36 @@
+#include "module_loader.h"
+#include <algorithm>
+#include <cctype>
+#include <windows.h>
+
+void *LoadModule(const std::string &path, const ModuleOptions &, std::string &error)
+{
+    void *handle = LoadLibraryA(path.c_str());
+    if (!handle)
+    {
+        error = "error " + std::to_string(GetLastError());
+    }
+    return handle;
+}
+
+void *FindModuleSymbol(void *handle, const std::string &name)
+{
+    return reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(handle), name.c_str()));
+}
+
+void UnloadModule(void *handle)
+{
+    FreeLibrary(static_cast<HMODULE>(handle));
+}
+
+// Paths are case-insensitive and accept either separator.
+std::string NormalizeModulePath(const std::string &path)
+{
+    char buffer[MAX_PATH];
+    DWORD length = GetFullPathNameA(path.c_str(), MAX_PATH, buffer, nullptr);
+    std::string normalized = length > 0 && length < MAX_PATH ? std::string(buffer, length) : path;
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(),
+                   [](unsigned char c)
+                   { return static_cast<char>(c == '/' ? '\\' : std::tolower(c)); });
+    return normalized;
+}
@@ -0,0 +1,199 @@
+#include "native_memory.h"
+#include "memory_pool.h"
+#include "struct_type.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+static uint8_t *GetPointer(const Napi::CallbackInfo &info, size_t index)
+{
+    Napi::Value value = info[index];
+    if (value.IsExternal())
+    {
+        return static_cast<uint8_t *>(value.As<Napi::External<void>>().Data());
+    }
+    if (value.IsNull() || value.IsUndefined())
+    {
+        throw Napi::TypeError::New(info.Env(), "Null pointer");
+    }
+    throw Napi::TypeError::New(info.Env(), "Expected a pointer");
+}
+
+static size_t GetSize(const Napi::CallbackInfo &info, size_t index, const char *name)
+{
+    if (info.Length() <= index || info[index].IsUndefined())
+    {
+        return 0;
+    }
+    if (!info[index].IsNumber())
+    {
+        throw Napi::TypeError::New(info.Env(), std::string(name) + " must be a number");
+    }
+    // Checked before any cast: NaN and values beyond size_t do not convert.
+    double value = info[index].As<Napi::Number>().DoubleValue();
+    if (!std::isfinite(value) || value < 0 || value >= static_cast<double>(SIZE_MAX) || value != std::floor(value))
+    {
+        throw Napi::RangeError::New(info.Env(), std::string(name) + " must be a non-negative integer");
+    }
+    return static_cast<size_t>(value);
+}
+
+// alloc(size): zeroed memory, released with free().
+static Napi::Value Alloc(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 1)
+    {
+        throw Napi::TypeError::New(env, "Expected a size");
+    }
+
+    size_t size = GetSize(info, 0, "size");
+    try
+    {
+        return Napi::External<void>::New(env, PoolAllocate(size));
+    }
+    catch (const std::bad_alloc &)
+    {
+        throw Napi::RangeError::New(env, "Out of memory");
+    }
+}
+
+static Napi::Value Free(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() > 0 && (info[0].IsNull() || info[0].IsUndefined()))
+    {
+        return env.Undefined();
+    }
+    if (!PoolFree(GetPointer(info, 0)))
+    {
+        throw Napi::Error::New(env, "Pointer was not allocated with memory.alloc or was already freed");
+    }
+    return env.Undefined();
+}
+
+static ValueType GetAccessType(const Napi::CallbackInfo &info, size_t index, std::shared_ptr<const StructLayout> &layout)
+{
+    if (info.Length() <= index || !info[index].IsString())
+    {
+        throw Napi::TypeError::New(info.Env(), "Expected a type name");
+    }
+    return ResolveType(info.Env(), info[index].As<Napi::String>().Utf8Value(), layout);
+}
+
+// read(ptr, type, offset): the value stored at ptr + offset. Structs come
+// back as views over the memory, string types follow the stored pointer.
+static Napi::Value Read(const Napi::CallbackInfo &info)
+{
+    uint8_t *ptr = GetPointer(info, 0);
+    std::shared_ptr<const StructLayout> layout;
+    ValueType type = GetAccessType(info, 1, layout);
+    size_t offset = GetSize(info, 2, "offset");
+
+    if (type == TYPE_VOID)
+    {
+        throw Napi::TypeError::New(info.Env(), "Cannot read a value of type void");
+    }
+    if (type == TYPE_STRUCT)
+    {
+        return StructToJs(info.Env(), *layout, ptr + offset, false);
+    }
+    return ConvertNativeToJsValue(info.Env(), ptr + offset, type, layout.get());
+}
+
+// write(ptr, type, value, offset)
+static Napi::Value Write(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    uint8_t *ptr = GetPointer(info, 0);
+    std::shared_ptr<const StructLayout> layout;
+    ValueType type = GetAccessType(info, 1, layout);
+    size_t offset = GetSize(info, 3, "offset");
+
+    switch (type)
+    {
+    case TYPE_VOID:
+    case TYPE_STRING:
+    case TYPE_WSTRING:
+    case TYPE_STRUCT_PTR:
+        throw Napi::TypeError::New(env, "Cannot write a value of type " + info[1].As<Napi::String>().Utf8Value());
+    case TYPE_STRUCT:
+        ConvertStructToNative(info[2], *layout, ptr + offset, nullptr);
+        break;
+    case TYPE_BUFFER:
+    case TYPE_UINT8_PTR:
+    case TYPE_INT32_PTR:
+    case TYPE_DOUBLE_PTR:
+        ConvertJsValueToScalar(info[2], TYPE_POINTER, ptr + offset);
+        break;
+    default:
+        if (IsArrayType(type))
+        {
+            ConvertJsValueToScalar(info[2], TYPE_POINTER, ptr + offset);
+            break;
+        }
+        if (info[2].IsNull() || info[2].IsUndefined())
+        {
+            memset(ptr + offset, 0, GetTypeSize(type));
+            break;
+        }
+        ConvertJsValueToScalar(info[2], type, ptr + offset);
+        break;
+    }
+    return env.Undefined();
+}
+
+// readCString(ptr, offset, maxLength): UTF-8 text up to the terminator or
+// maxLength bytes, whichever comes first.
+static Napi::Value ReadCString(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() > 0 && (info[0].IsNull() || info[0].IsUndefined()))
+    {
+        return env.Null();
+    }
+
+    const char *str = reinterpret_cast<const char *>(GetPointer(info, 0) + GetSize(info, 1, "offset"));
+    if (info.Length() > 2 && !info[2].IsUndefined())
+    {
+        size_t maxLength = GetSize(info, 2, "maxLength");
+        const void *end = memchr(str, 0, maxLength);
+        size_t length = end ? static_cast<size_t>(static_cast<const char *>(end) - str) : maxLength;
+        return Napi::String::New(env, str, length);
+    }
+    return Napi::String::New(env, str);
+}
+
+// toArrayBuffer(ptr, length): a view over native memory. It is only valid
+// while that memory is, and is not freed with the ArrayBuffer.
+static Napi::Value ToArrayBuffer(const Napi::CallbackInfo &info)
+{
+    uint8_t *ptr = GetPointer(info, 0);
+    size_t length = GetSize(info, 1, "length");
+    return Napi::ArrayBuffer::New(info.Env(), ptr, length);
+}
+
+// offset(ptr, bytes): pointer arithmetic; bytes may be negative.
+static Napi::Value Offset(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    uint8_t *ptr = GetPointer(info, 0);
+    if (info.Length() < 2 || !info[1].IsNumber())
+    {
+        throw Napi::TypeError::New(env, "Expected a byte offset");
+    }
+    return Napi::External<void>::New(env, ptr + info[1].As<Napi::Number>().Int64Value());
+}
+
+void InitMemory(Napi::Env env, Napi::Object exports)
+{
+    Napi::Object memory = Napi::Object::New(env);
+    memory.Set("alloc", Napi::Function::New(env, Alloc, "alloc"));
+    memory.Set("free", Napi::Function::New(env, Free, "free"));
+    memory.Set("read", Napi::Function::New(env, Read, "read"));
+    memory.Set("write", Napi::Function::New(env, Write, "write"));
+    memory.Set("readCString", Napi::Function::New(env, ReadCString, "readCString"));
+    memory.Set("toArrayBuffer", Napi::Function::New(env, ToArrayBuffer, "toArrayBuffer"));
+    memory.Set("offset", Napi::Function::New(env, Offset, "offset"));
+    exports.Set("memory", memory);
+}
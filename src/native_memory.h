@@ -0,0 +1,7 @@
+#pragma once
+
+#include <napi.h>
+
+// The `memory` export: native allocation, typed reads and writes through
+// pointers, and zero-copy views.
+void InitMemory(Napi::Env env, Napi::Object exports);
@@ -0,0 +1,111 @@
+#include "native_task.h"
+#include "executor.h"
+
+class TaskWorker : public Napi::AsyncWorker
+{
+public:
+    TaskWorker(Napi::Env env, std::unique_ptr<NativeTask> task)
+        : Napi::AsyncWorker(env, "ffi-libraries:call"), task(std::move(task)) {}
+
+    void Execute() override { task->Execute(); }
+    void OnOK() override { task->Complete(Env()); }
+    void OnError(const Napi::Error &) override { task->Complete(Env()); }
+
+private:
+    std::unique_ptr<NativeTask> task;
+};
+
+NativeTask::NativeTask(Napi::Env env, Napi::Value callback)
+{
+    if (callback.IsFunction())
+    {
+        this->callback = Napi::Persistent(callback.As<Napi::Function>());
+    }
+    else
+    {
+        deferred.reset(new Napi::Promise::Deferred(env));
+    }
+}
+
+Napi::Value NativeTask::Promise(Napi::Env env) const
+{
+    return deferred ? deferred->Promise() : env.Undefined();
+}
+
+void NativeTask::Complete(Napi::Env env)
+{
+    Napi::HandleScope scope(env);
+
+    if (failed)
+    {
+        OnError(env, Napi::Error::New(env, error));
+        return;
+    }
+
+    // A result that fails to convert rejects the call instead of leaving it
+    // pending. Errors thrown by the callback itself stay uncaught.
+    try
+    {
+        OnOK(env);
+    }
+    catch (const Napi::Error &e)
+    {
+        if (settled)
+        {
+            throw;
+        }
+        OnError(env, e);
+    }
+    catch (const std::exception &e)
+    {
+        if (settled)
+        {
+            throw;
+        }
+        OnError(env, Napi::Error::New(env, e.what()));
+    }
+}
+
+void NativeTask::OnError(Napi::Env env, const Napi::Error &e)
+{
+    Reject(env, e);
+}
+
+void NativeTask::Resolve(Napi::Env env, Napi::Value value)
+{
+    settled = true;
+    if (deferred)
+    {
+        deferred->Resolve(value);
+        return;
+    }
+    callback.Call({env.Null(), value});
+}
+
+void NativeTask::Reject(Napi::Env env, const Napi::Error &e, Napi::Value partial)
+{
+    settled = true;
+    if (deferred)
+    {
+        deferred->Reject(e.Value());
+        return;
+    }
+    callback.Call({e.Value(), partial.IsEmpty() ? env.Undefined() : partial});
+}
+
+void NativeTask::SetError(const std::string &message)
+{
+    failed = true;
+    error = message;
+}
+
+void ScheduleTask(Napi::Env env, const std::shared_ptr<Executor> &executor, std::unique_ptr<NativeTask> task)
+{
+    if (executor)
+    {
+        executor->Submit(env, std::move(task));
+        return;
+    }
+
+    (new TaskWorker(env, std::move(task)))->Queue();
+}
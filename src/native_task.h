@@ -0,0 +1,40 @@
+#pragma once
+
+#include <napi.h>
+#include <memory>
+#include <string>
+
+class Executor;
+
+// Work that runs off the JS thread and settles back on it, either through
+// the libuv threadpool or through a library's executor. A task settles a
+// Node-style callback when given a function and a native promise otherwise.
+class NativeTask
+{
+public:
+    NativeTask(Napi::Env env, Napi::Value callback);
+    virtual ~NativeTask() {}
+
+    virtual void Execute() = 0;
+    void Complete(Napi::Env env);
+
+    // The promise settled by this task, or undefined in callback mode.
+    Napi::Value Promise(Napi::Env env) const;
+
+protected:
+    virtual void OnOK(Napi::Env env) = 0;
+    virtual void OnError(Napi::Env env, const Napi::Error &e);
+    void SetError(const std::string &message);
+
+    void Resolve(Napi::Env env, Napi::Value value);
+    void Reject(Napi::Env env, const Napi::Error &e, Napi::Value partial = Napi::Value());
+
+private:
+    Napi::FunctionReference callback;
+    std::unique_ptr<Napi::Promise::Deferred> deferred;
+    std::string error;
+    bool failed = false;
+    bool settled = false;
+};
+
+void ScheduleTask(Napi::Env env, const std::shared_ptr<Executor> &executor, std::unique_ptr<NativeTask> task);
@@ -0,0 +1,214 @@
+#include "pipeline.h"
+#include "addon_data.h"
+#include "library_wrapper.h"
+#include "native_task.h"
+#include "variadic_signatures.h"
+
+static bool IsIntegerType(ValueType type)
+{
+    switch (type)
+    {
+    case TYPE_INT8:
+    case TYPE_UINT8:
+    case TYPE_INT16:
+    case TYPE_UINT16:
+    case TYPE_INT32:
+    case TYPE_UINT32:
+    case TYPE_INT64:
+    case TYPE_UINT64:
+    case TYPE_BOOL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int64_t ReadIntegerResult(const void *data, ValueType type)
+{
+    switch (type)
+    {
+    case TYPE_INT8:
+        return *static_cast<const int8_t *>(data);
+    case TYPE_UINT8:
+        return *static_cast<const uint8_t *>(data);
+    case TYPE_INT16:
+        return *static_cast<const int16_t *>(data);
+    case TYPE_UINT16:
+        return *static_cast<const uint16_t *>(data);
+    case TYPE_INT32:
+        return *static_cast<const int32_t *>(data);
+    case TYPE_UINT32:
+        return *static_cast<const uint32_t *>(data);
+    case TYPE_BOOL:
+        return *static_cast<const bool *>(data) ? 1 : 0;
+    default:
+        return *static_cast<const int64_t *>(data);
+    }
+}
+
+void PipelineWrapper::Init(Napi::Env env)
+{
+    Napi::Function func = DefineClass(env, "Pipeline", {InstanceMethod("call", &PipelineWrapper::Call),
+                                                        InstanceMethod("run", &PipelineWrapper::Run)});
+
+    env.GetInstanceData<AddonData>()->pipelineConstructor = Napi::Persistent(func);
+}
+
+PipelineWrapper::PipelineWrapper(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<PipelineWrapper>(info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject())
+    {
+        throw Napi::TypeError::New(env, "Pipelines are created with library.pipeline()");
+    }
+    library = Napi::Persistent(info[0].As<Napi::Object>());
+    closed = LibraryWrapper::Unwrap(library.Value())->GetClosedFlag();
+
+    if (info.Length() > 1 && info[1].IsObject())
+    {
+        Napi::Object options = info[1].As<Napi::Object>();
+        if (options.Has("successCode"))
+        {
+            checkStatus = true;
+            successCode = options.Get("successCode").As<Napi::Number>().Int64Value();
+        }
+    }
+}
+
+Napi::Value PipelineWrapper::Call(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString())
+    {
+        throw Napi::TypeError::New(env, "Expected function name");
+    }
+
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    LibraryWrapper *wrapper = LibraryWrapper::Unwrap(library.Value());
+    std::shared_ptr<const CallPlan> plan = wrapper->FindFunction(env, name);
+    if (!plan)
+    {
+        throw Napi::Error::New(env, "Function is not defined on this library: " + name);
+    }
+
+    // Extra arguments of a variadic function select the plan of their shape.
+    size_t argc = info.Length() - 1;
+    size_t fixed = plan->paramTypes.size();
+    if (plan->variadic && argc > fixed)
+    {
+        plan = plan->variadic->Get(info, 1 + fixed, argc - fixed);
+    }
+
+    Step step;
+    step.name = name;
+    step.plan = plan;
+    step.frame.reset(new CallFrame(*plan));
+    step.frame->RetainValues();
+    step.frame->MarshalArguments(info, 1, argc);
+    steps.push_back(std::move(step));
+
+    return info.This();
+}
+
+Napi::Value PipelineWrapper::Run(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    CheckOpen(env, closed);
+
+    if (info.Length() > 0 && !info[info.Length() - 1].IsFunction())
+    {
+        throw Napi::TypeError::New(env, "Last argument must be a callback function");
+    }
+    if (steps.empty())
+    {
+        throw Napi::Error::New(env, "Pipeline has no steps to run");
+    }
+
+    // Without a callback the pipeline settles a promise instead.
+    Napi::Value callback = info.Length() > 0 ? info[info.Length() - 1] : env.Undefined();
+
+    class PipelineTask : public NativeTask
+    {
+    public:
+        PipelineTask(Napi::Env env, Napi::Value callback, Napi::Object library, std::vector<Step> steps,
+                     bool checkStatus, int64_t successCode)
+            : NativeTask(env, callback), steps(std::move(steps)),
+              checkStatus(checkStatus), successCode(successCode)
+        {
+            this->library = Napi::Persistent(library);
+        }
+
+        void Execute() override
+        {
+            try
+            {
+                for (Step &step : steps)
+                {
+                    step.frame->Invoke();
+                    completed++;
+
+                    ValueType returnType = step.plan->returnType;
+                    if (IsStringType(returnType))
+                    {
+                        step.frame->OwnResultString();
+                    }
+                    else if (IsArrayType(returnType))
+                    {
+                        step.frame->OwnResultArray();
+                    }
+                    else if (checkStatus && IsIntegerType(returnType) &&
+                             ReadIntegerResult(step.frame->Result(), returnType) != successCode)
+                    {
+                        stopped = true;
+                        break;
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                SetError(e.what());
+            }
+        }
+
+        void OnOK(Napi::Env env) override
+        {
+            Napi::Array results = Napi::Array::New(env, completed);
+            for (size_t i = 0; i < completed; i++)
+            {
+                results.Set(static_cast<uint32_t>(i), steps[i].frame->ResultToJs(env));
+            }
+
+            if (!stopped)
+            {
+                Resolve(env, results);
+                return;
+            }
+
+            const Step &step = steps[completed - 1];
+            Napi::Error error = Napi::Error::New(env, "Pipeline stopped at step " + std::to_string(completed - 1) +
+                                                          " (" + step.name + ")");
+            error.Set("step", Napi::Number::New(env, static_cast<double>(completed - 1)));
+            error.Set("results", results);
+            Reject(env, error, results);
+        }
+
+    private:
+        Napi::ObjectReference library;
+        std::vector<Step> steps;
+        bool checkStatus;
+        int64_t successCode;
+        size_t completed = 0;
+        bool stopped = false;
+    };
+
+    LibraryWrapper *wrapper = LibraryWrapper::Unwrap(library.Value());
+    std::unique_ptr<NativeTask> task(new PipelineTask(env, callback, library.Value(), std::move(steps), checkStatus, successCode));
+    steps.clear();
+    Napi::Value result = task->Promise(env);
+    ScheduleTask(env, wrapper->GetExecutor(), std::move(task));
+
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "call_frame.h"
+
+// A recorded sequence of calls on one Library, executed on a single worker.
+// Arguments are marshalled when a step is recorded; run() hands the steps
+// to the worker and leaves the pipeline empty.
+class PipelineWrapper : public Napi::ObjectWrap<PipelineWrapper>
+{
+public:
+    struct Step
+    {
+        std::string name;
+        std::shared_ptr<const CallPlan> plan;
+        std::unique_ptr<CallFrame> frame;
+    };
+
+    static void Init(Napi::Env env);
+    PipelineWrapper(const Napi::CallbackInfo &info);
+
+private:
+    Napi::ObjectReference library;
+    ClosedFlag closed;
+    std::vector<Step> steps;
+    bool checkStatus = false;
+    int64_t successCode = 0;
+
+    Napi::Value Call(const Napi::CallbackInfo &info);
+    Napi::Value Run(const Napi::CallbackInfo &info);
+};
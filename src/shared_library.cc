@@ -0,0 +1,73 @@
+#include "shared_library.h"
+
+// Entries by normalized path and by module handle. Loading the same DLL
+// through a different path (a bare name, a relative path) finds the
+// existing entry through its handle.
+static std::mutex registryMutex;
+static std::map<std::string, std::weak_ptr<SharedLibrary>> byPath;
+static std::map<void *, std::weak_ptr<SharedLibrary>> byHandle;
+
+std::shared_ptr<SharedLibrary> SharedLibrary::Open(const std::string &path, const ModuleOptions &options, std::string &error)
+{
+    std::string key = NormalizeModulePath(path);
+    std::lock_guard<std::mutex> lock(registryMutex);
+
+    std::shared_ptr<SharedLibrary> library = byPath[key].lock();
+    if (library)
+    {
+        return library;
+    }
+
+    void *handle = LoadModule(path, options, error);
+    if (!handle)
+    {
+        byPath.erase(key);
+        return nullptr;
+    }
+
+    library = byHandle[handle].lock();
+    if (library)
+    {
+        // Drop the reference this load added; the entry holds its own.
+        UnloadModule(handle);
+    }
+    else
+    {
+        library.reset(new SharedLibrary(handle));
+        byHandle[handle] = library;
+    }
+    byPath[key] = library;
+    return library;
+}
+
+SharedLibrary::~SharedLibrary()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        // An entry reopened while this one was being released is kept.
+        for (auto it = byPath.begin(); it != byPath.end();)
+        {
+            it = it->second.expired() ? byPath.erase(it) : std::next(it);
+        }
+        auto it = byHandle.find(handle);
+        if (it != byHandle.end() && it->second.expired())
+        {
+            byHandle.erase(it);
+        }
+    }
+    UnloadModule(handle);
+}
+
+void *SharedLibrary::Symbol(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = symbols.find(name);
+    if (it != symbols.end())
+    {
+        return it->second;
+    }
+
+    void *address = FindModuleSymbol(handle, name);
+    symbols[name] = address;
+    return address;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "module_loader.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// A loaded module shared by every Library opened on the same file. The
+// registry holds it weakly: the last Library to close it unloads it.
+// Symbol addresses are looked up once per module, not once per Library.
+// Loader options only apply to the open that actually loads the module.
+class SharedLibrary
+{
+public:
+    static std::shared_ptr<SharedLibrary> Open(const std::string &path, const ModuleOptions &options, std::string &error);
+    ~SharedLibrary();
+
+    SharedLibrary(const SharedLibrary &) = delete;
+    SharedLibrary &operator=(const SharedLibrary &) = delete;
+
+    void *Symbol(const std::string &name);
+
+private:
+    explicit SharedLibrary(void *handle) : handle(handle) {}
+
+    void *handle;
+    std::mutex mutex;
+    std::map<std::string, void *> symbols;
+};
@@ -0,0 +1,96 @@
+#include "string_result.h"
+#include "call_frame.h"
+#include <cstdlib>
+#include <cstring>
+
+// Keeps the free function alive for strings whose finalizer runs after the
+// library wrapper is gone.
+struct StringRelease
+{
+    std::shared_ptr<const CallPlan> plan;
+    StringOwnership ownership;
+};
+
+static void FinalizeString(napi_env, void *data, void *hint)
+{
+    StringRelease *release = static_cast<StringRelease *>(hint);
+    ReleaseString(*release->plan, static_cast<char *>(data), release->ownership);
+    delete release;
+}
+
+void ReleaseString(const CallPlan &plan, char *str, StringOwnership ownership)
+{
+    if (ownership == STRING_MALLOC)
+    {
+        free(str);
+    }
+    else if (ownership == STRING_FREE_FUNCTION && plan.freePlan)
+    {
+        CallFrame frame(*plan.freePlan);
+        *static_cast<void **>(frame.Slot(0)) = str;
+        frame.Invoke();
+    }
+}
+
+Napi::Value StringResultToJs(Napi::Env env, const CallPlan &plan, char *str, StringOwnership ownership)
+{
+    if (!str)
+    {
+        return env.Null();
+    }
+
+    size_t length = strlen(str);
+    napi_value result;
+    napi_status status;
+
+    switch (plan.stringReturn)
+    {
+    case STRING_LATIN1:
+        status = napi_create_string_latin1(env, str, length, &result);
+        break;
+    case STRING_BUFFER:
+        if (ownership == STRING_BORROWED)
+        {
+            return Napi::Buffer<char>::Copy(env, str, length);
+        }
+        return Napi::Buffer<char>::NewOrCopy(
+            env, str, length,
+            [](Napi::Env, char *data, StringRelease *release)
+            {
+                ReleaseString(*release->plan, data, release->ownership);
+                delete release;
+            },
+            new StringRelease{plan.freePlan, ownership});
+    case STRING_EXTERNAL:
+    {
+        std::shared_ptr<const CallPlan> freePlan = plan.freePlan;
+        if (ownership == STRING_BORROWED)
+        {
+            char *copy = static_cast<char *>(malloc(length + 1));
+            if (!copy)
+            {
+                throw std::bad_alloc();
+            }
+            memcpy(copy, str, length + 1);
+            str = copy;
+            ownership = STRING_MALLOC;
+        }
+        status = CreateExternalLatin1(env, str, length, FinalizeString, new StringRelease{freePlan, ownership}, &result);
+        if (status != napi_ok)
+        {
+            throw Napi::Error::New(env);
+        }
+        return Napi::Value(env, result);
+    }
+    default:
+        status = napi_create_string_utf8(env, str, length, &result);
+        break;
+    }
+
+    ReleaseString(plan, str, ownership);
+    if (status != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    return Napi::Value(env, result);
+}
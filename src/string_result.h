@@ -0,0 +1,16 @@
+#pragma once
+
+#include "call_plan.h"
+
+// Who owns a returned C string by the time it is converted.
+enum StringOwnership
+{
+    STRING_BORROWED,      // library memory, copied before use
+    STRING_FREE_FUNCTION, // released through the plan's free function
+    STRING_MALLOC         // copied off the worker thread, released with free()
+};
+
+Napi::Value StringResultToJs(Napi::Env env, const CallPlan &plan, char *str, StringOwnership ownership);
+void ReleaseString(const CallPlan &plan, char *str, StringOwnership ownership);
+
+napi_status CreateExternalLatin1(napi_env env, char *str, size_t length, napi_finalize finalize, void *hint, napi_value *result);
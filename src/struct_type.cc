@@ -0,0 +1,469 @@
+#include "struct_type.h"
+#include "addon_data.h"
+#include "call_frame.h"
+#include <algorithm>
+#include <cstring>
+
+static const napi_type_tag kStructViewTag = {0x6666692d6c696273ULL, 0x7374727563747669ULL};
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+std::shared_ptr<const StructLayout> FindStruct(Napi::Env env, const std::string &name)
+{
+    AddonData *data = env.GetInstanceData<AddonData>();
+    auto it = data->structs.find(name);
+    if (it == data->structs.end())
+    {
+        return nullptr;
+    }
+    return it->second.layout;
+}
+
+static Napi::Function GetConstructor(Napi::Env env, const StructLayout &layout)
+{
+    return env.GetInstanceData<AddonData>()->structs.at(layout.name).constructor.Value();
+}
+
+// Struct names resolve to the struct by value and "Name*" to a pointer to
+// it; everything else is a scalar type name.
+ValueType ResolveType(Napi::Env env, const std::string &typeStr, std::shared_ptr<const StructLayout> &layout)
+{
+    layout = FindStruct(env, typeStr);
+    if (layout)
+    {
+        return TYPE_STRUCT;
+    }
+
+    if (typeStr.size() > 1 && typeStr.back() == '*')
+    {
+        layout = FindStruct(env, typeStr.substr(0, typeStr.size() - 1));
+        if (layout)
+        {
+            return TYPE_STRUCT_PTR;
+        }
+    }
+
+    return GetTypeFromString(typeStr, env);
+}
+
+static void *GetStructPointer(Napi::Value value, const StructLayout &layout)
+{
+    if (value.IsNull() || value.IsUndefined())
+    {
+        return nullptr;
+    }
+    if (value.IsExternal())
+    {
+        return value.As<Napi::External<void>>().Data();
+    }
+
+    StructView *view = StructView::FromValue(value);
+    if (!view || &view->Layout() != &layout)
+    {
+        throw Napi::TypeError::New(value.Env(), "Expected a " + layout.name + " struct");
+    }
+    return view->Data();
+}
+
+static void WriteField(const StructField &field, Napi::Value value, uint8_t *ptr, CallFrame *frame)
+{
+    switch (field.type)
+    {
+    case TYPE_STRUCT:
+        ConvertStructToNative(value, *field.layout, ptr, frame);
+        break;
+    case TYPE_STRUCT_PTR:
+        *reinterpret_cast<void **>(ptr) = GetStructPointer(value, *field.layout);
+        break;
+    case TYPE_STRING:
+    case TYPE_WSTRING:
+        // The encoded string must outlive the call, so it is only written
+        // into argument copies that live in a call frame.
+        if (!frame)
+        {
+            throw Napi::TypeError::New(value.Env(), "String field " + field.name + " can only be set from a call argument");
+        }
+        ConvertJsValueToNative(value, field.type, ptr, *frame);
+        break;
+    default:
+        ConvertJsValueToScalar(value, field.type, ptr);
+        break;
+    }
+}
+
+static Napi::Value ReadField(Napi::Env env, const StructField &field, uint8_t *ptr, Napi::Value backing, size_t offset)
+{
+    switch (field.type)
+    {
+    case TYPE_STRUCT:
+        if (backing.IsEmpty())
+        {
+            return GetConstructor(env, *field.layout).New({Napi::External<void>::New(env, ptr)});
+        }
+        return GetConstructor(env, *field.layout).New({backing, Napi::Number::New(env, static_cast<double>(offset))});
+    case TYPE_STRUCT_PTR:
+        return StructToJs(env, *field.layout, *reinterpret_cast<void **>(ptr), false);
+    default:
+        return ConvertNativeToJsValue(env, ptr, field.type);
+    }
+}
+
+void ConvertStructToNative(Napi::Value value, const StructLayout &layout, void *slot, CallFrame *frame)
+{
+    if (value.IsNull() || value.IsUndefined())
+    {
+        memset(slot, 0, layout.size);
+        return;
+    }
+
+    StructView *view = StructView::FromValue(value);
+    if (view)
+    {
+        if (&view->Layout() != &layout)
+        {
+            throw Napi::TypeError::New(value.Env(), "Expected a " + layout.name + " struct");
+        }
+        memcpy(slot, view->Data(), layout.size);
+        return;
+    }
+
+    if (!value.IsObject())
+    {
+        throw Napi::TypeError::New(value.Env(), "Expected a " + layout.name + " struct or a plain object");
+    }
+
+    Napi::Object object = value.As<Napi::Object>();
+    uint8_t *bytes = static_cast<uint8_t *>(slot);
+    memset(bytes, 0, layout.size);
+    for (const StructField &field : layout.fields)
+    {
+        Napi::Value fieldValue = object.Get(field.name);
+        if (!fieldValue.IsUndefined())
+        {
+            WriteField(field, fieldValue, bytes + field.offset, frame);
+        }
+    }
+}
+
+// Address passed for a struct pointer parameter. Views and buffers are
+// passed in place and kept alive with the frame; a plain object is copied
+// into the frame, so changes made by the callee are not visible to JS.
+void *GetStructAddress(Napi::Value value, const StructLayout &layout, CallFrame &frame)
+{
+    if (value.IsNull() || value.IsUndefined())
+    {
+        return nullptr;
+    }
+    if (value.IsExternal())
+    {
+        return value.As<Napi::External<void>>().Data();
+    }
+    if (value.IsTypedArray() || value.IsArrayBuffer() || value.IsDataView())
+    {
+        void *address;
+        ConvertJsValueToNative(value, TYPE_BUFFER, &address, frame);
+        return address;
+    }
+
+    StructView *view = StructView::FromValue(value);
+    if (view)
+    {
+        if (&view->Layout() != &layout)
+        {
+            throw Napi::TypeError::New(value.Env(), "Expected a " + layout.name + " struct");
+        }
+        frame.Retain(value);
+        return view->Data();
+    }
+
+    void *copy = frame.Allocate(layout.size, layout.alignment);
+    ConvertStructToNative(value, layout, copy, &frame);
+    return copy;
+}
+
+Napi::Value StructToJs(Napi::Env env, const StructLayout &layout, void *data, bool copy)
+{
+    if (!data)
+    {
+        return env.Null();
+    }
+
+    Napi::Function constructor = GetConstructor(env, layout);
+    if (!copy)
+    {
+        return constructor.New({Napi::External<void>::New(env, data)});
+    }
+
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, layout.size);
+    memcpy(buffer.Data(), data, layout.size);
+    return constructor.New({buffer});
+}
+
+Napi::Function StructView::DefineView(Napi::Env env, const StructLayout &layout)
+{
+    std::vector<PropertyDescriptor> properties;
+    for (const StructField &field : layout.fields)
+    {
+        properties.push_back(InstanceAccessor(field.name.c_str(), &StructView::GetField, &StructView::SetField,
+                                              napi_enumerable, const_cast<StructField *>(&field)));
+    }
+    properties.push_back(InstanceMethod("toObject", &StructView::ToObject));
+
+    Napi::Function constructor = DefineClass(env, layout.name.c_str(), properties, const_cast<StructLayout *>(&layout));
+    constructor.Set("size", Napi::Number::New(env, static_cast<double>(layout.size)));
+    constructor.Set("alignment", Napi::Number::New(env, static_cast<double>(layout.alignment)));
+    return constructor;
+}
+
+StructView *StructView::FromValue(Napi::Value value)
+{
+    if (!value.IsObject())
+    {
+        return nullptr;
+    }
+
+    bool tagged = false;
+    if (napi_check_object_type_tag(value.Env(), value, &kStructViewTag, &tagged) != napi_ok || !tagged)
+    {
+        return nullptr;
+    }
+    return StructView::Unwrap(value.As<Napi::Object>());
+}
+
+// new Type(), new Type({ field: value }), new Type(buffer[, byteOffset]) or
+// new Type(external) for memory returned by native code.
+StructView::StructView(const Napi::CallbackInfo &info)
+    : Napi::ObjectWrap<StructView>(info), layout(static_cast<const StructLayout *>(info.Data())), data(nullptr)
+{
+    Napi::Env env = info.Env();
+    Napi::Value source = info.Length() > 0 ? info[0] : env.Undefined();
+    size_t offset = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Uint32Value() : 0;
+
+    if (source.IsExternal())
+    {
+        data = static_cast<uint8_t *>(source.As<Napi::External<void>>().Data());
+    }
+    else if (source.IsArrayBuffer() || source.IsTypedArray() || source.IsDataView())
+    {
+        Napi::ArrayBuffer buffer;
+        if (source.IsArrayBuffer())
+        {
+            buffer = source.As<Napi::ArrayBuffer>();
+        }
+        else if (source.IsTypedArray())
+        {
+            Napi::TypedArray view = source.As<Napi::TypedArray>();
+            buffer = view.ArrayBuffer();
+            offset += view.ByteOffset();
+        }
+        else
+        {
+            Napi::DataView view = source.As<Napi::DataView>();
+            buffer = view.ArrayBuffer();
+            offset += view.ByteOffset();
+        }
+
+        if (offset + layout->size > buffer.ByteLength())
+        {
+            throw Napi::RangeError::New(env, "Buffer is too small for struct " + layout->name);
+        }
+        data = static_cast<uint8_t *>(buffer.Data()) + offset;
+        backing = Napi::Persistent(buffer.As<Napi::Object>());
+    }
+    else
+    {
+        Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, layout->size);
+        data = static_cast<uint8_t *>(buffer.Data());
+        memset(data, 0, layout->size);
+        backing = Napi::Persistent(buffer.As<Napi::Object>());
+
+        if (!source.IsUndefined())
+        {
+            ConvertStructToNative(source, *layout, data, nullptr);
+        }
+    }
+
+    if (napi_type_tag_object(env, info.This(), &kStructViewTag) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+}
+
+Napi::Value StructView::GetField(const Napi::CallbackInfo &info)
+{
+    const StructField &field = *static_cast<const StructField *>(info.Data());
+    Napi::Value buffer = backing.IsEmpty() ? Napi::Value() : backing.Value();
+    size_t base = backing.IsEmpty() ? 0 : data - static_cast<uint8_t *>(backing.Value().As<Napi::ArrayBuffer>().Data());
+    return ReadField(info.Env(), field, data + field.offset, buffer, base + field.offset);
+}
+
+void StructView::SetField(const Napi::CallbackInfo &info, const Napi::Value &value)
+{
+    const StructField &field = *static_cast<const StructField *>(info.Data());
+    WriteField(field, value, data + field.offset, nullptr);
+}
+
+// Plain object snapshot of every field, nested structs included.
+Napi::Value StructView::ToObject(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    Napi::Object object = Napi::Object::New(env);
+    for (const StructField &field : layout->fields)
+    {
+        Napi::Value value;
+        if (field.type == TYPE_STRUCT)
+        {
+            StructView *nested = FromValue(GetConstructor(env, *field.layout).New({Napi::External<void>::New(env, data + field.offset)}));
+            value = nested->ToObject(info);
+        }
+        else
+        {
+            value = ReadField(env, field, data + field.offset, Napi::Value(), 0);
+        }
+        object.Set(field.name, value);
+    }
+    return object;
+}
+
+static bool IsFieldType(ValueType type)
+{
+    return type != TYPE_VOID && !IsBufferType(type) && !IsArrayType(type);
+}
+
+// Struct names are looked up before the built-in types, so one must not
+// shadow a built-in type or read as a pointer, an array or '...'.
+static bool IsReservedTypeName(Napi::Env env, const std::string &name)
+{
+    if (name == "..." || (!name.empty() && name.back() == '*') ||
+        (name.size() >= 2 && name.compare(name.size() - 2, 2, "[]") == 0))
+    {
+        return true;
+    }
+    try
+    {
+        GetTypeFromString(name, env);
+        return true;
+    }
+    catch (const Napi::Error &)
+    {
+        return false;
+    }
+}
+
+// Struct(name, { field: type, ... }, { pack }) registers a struct type and
+// returns its constructor. Fields are laid out in declaration order with C
+// alignment rules, capped at pack bytes when pack is given.
+static Napi::Value DefineStruct(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsObject())
+    {
+        throw Napi::TypeError::New(env, "Expected struct name and field definitions");
+    }
+
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    if (IsReservedTypeName(env, name))
+    {
+        throw Napi::TypeError::New(env, "Struct name is reserved for a built-in type: " + name);
+    }
+    if (FindStruct(env, name))
+    {
+        throw Napi::Error::New(env, "Struct is already defined: " + name);
+    }
+
+    size_t pack = 0;
+    if (info.Length() > 2 && info[2].IsObject())
+    {
+        Napi::Object options = info[2].As<Napi::Object>();
+        if (options.Has("pack"))
+        {
+            pack = options.Get("pack").As<Napi::Number>().Uint32Value();
+            if (pack == 0 || pack > 16 || (pack & (pack - 1)))
+            {
+                throw Napi::RangeError::New(env, "pack must be 1, 2, 4, 8 or 16");
+            }
+        }
+    }
+
+    auto layout = std::make_shared<StructLayout>();
+    layout->name = name;
+
+    Napi::Object fieldDefs = info[1].As<Napi::Object>();
+    Napi::Array fieldNames = fieldDefs.GetPropertyNames();
+    size_t offset = 0;
+    size_t alignment = 1;
+
+    for (uint32_t i = 0; i < fieldNames.Length(); i++)
+    {
+        StructField field;
+        field.name = fieldNames.Get(i).As<Napi::String>().Utf8Value();
+        field.type = ResolveType(env, fieldDefs.Get(field.name).As<Napi::String>().Utf8Value(), field.layout);
+        if (!IsFieldType(field.type))
+        {
+            throw Napi::TypeError::New(env, "Unsupported type for struct field " + field.name);
+        }
+
+        size_t fieldAlignment;
+        if (field.type == TYPE_STRUCT)
+        {
+            field.size = field.layout->size;
+            fieldAlignment = field.layout->alignment;
+        }
+        else
+        {
+            field.size = GetTypeSize(field.type);
+            fieldAlignment = GetTypeAlignment(field.type);
+        }
+        if (pack)
+        {
+            fieldAlignment = std::min(fieldAlignment, pack);
+        }
+
+        offset = AlignUp(offset, fieldAlignment);
+        field.offset = offset;
+        offset += field.size;
+        alignment = std::max(alignment, fieldAlignment);
+        layout->fields.push_back(field);
+    }
+
+    if (layout->fields.empty())
+    {
+        throw Napi::TypeError::New(env, "Struct " + name + " needs at least one field");
+    }
+
+    layout->size = AlignUp(offset, alignment);
+    layout->alignment = alignment;
+    layout->composite.size = layout->size;
+    layout->composite.alignment = alignment;
+    for (const StructField &field : layout->fields)
+    {
+        if (field.type == TYPE_STRUCT)
+        {
+            for (CompositeMember member : field.layout->composite.members)
+            {
+                member.offset += field.offset;
+                layout->composite.members.push_back(member);
+            }
+        }
+        else
+        {
+            bool floating = field.type == TYPE_FLOAT || field.type == TYPE_DOUBLE;
+            layout->composite.members.push_back({field.offset, field.size, floating});
+        }
+    }
+
+    Napi::Function constructor = StructView::DefineView(env, *layout);
+    StructDefinition &definition = env.GetInstanceData<AddonData>()->structs[name];
+    definition.layout = layout;
+    definition.constructor = Napi::Persistent(constructor);
+    return constructor;
+}
+
+void InitStructs(Napi::Env env, Napi::Object exports)
+{
+    exports.Set("Struct", Napi::Function::New(env, DefineStruct, "Struct"));
+}
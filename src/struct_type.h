@@ -0,0 +1,64 @@
+#pragma once
+
+#include "common.h"
+#include "call_engine.h"
+#include <memory>
+
+struct StructField
+{
+    std::string name;
+    ValueType type;
+    // Nested struct for TYPE_STRUCT, pointee for TYPE_STRUCT_PTR.
+    std::shared_ptr<const StructLayout> layout;
+    size_t offset;
+    size_t size;
+};
+
+// Field offsets, alignment and packing of a Struct definition, computed once
+// and shared by the views and every call plan that uses the struct.
+struct StructLayout
+{
+    std::string name;
+    std::vector<StructField> fields;
+    size_t size;
+    size_t alignment;
+    CompositeType composite;
+};
+
+struct StructDefinition
+{
+    std::shared_ptr<const StructLayout> layout;
+    Napi::FunctionReference constructor;
+};
+
+// A struct instance: field accessors that read and write its memory in
+// place. The memory is an ArrayBuffer (owned or borrowed from a Buffer or
+// TypedArray) or native memory returned by a call, which the view does not
+// own.
+class StructView : public Napi::ObjectWrap<StructView>
+{
+public:
+    static Napi::Function DefineView(Napi::Env env, const StructLayout &layout);
+    static StructView *FromValue(Napi::Value value);
+    StructView(const Napi::CallbackInfo &info);
+
+    const StructLayout &Layout() const { return *layout; }
+    uint8_t *Data() const { return data; }
+
+private:
+    const StructLayout *layout;
+    uint8_t *data;
+    Napi::ObjectReference backing;
+
+    Napi::Value GetField(const Napi::CallbackInfo &info);
+    void SetField(const Napi::CallbackInfo &info, const Napi::Value &value);
+    Napi::Value ToObject(const Napi::CallbackInfo &info);
+};
+
+void InitStructs(Napi::Env env, Napi::Object exports);
+std::shared_ptr<const StructLayout> FindStruct(Napi::Env env, const std::string &name);
+ValueType ResolveType(Napi::Env env, const std::string &typeStr, std::shared_ptr<const StructLayout> &layout);
+
+void ConvertStructToNative(Napi::Value value, const StructLayout &layout, void *slot, CallFrame *frame);
+void *GetStructAddress(Napi::Value value, const StructLayout &layout, CallFrame &frame);
+Napi::Value StructToJs(Napi::Env env, const StructLayout &layout, void *data, bool copy);
@@ -4,20 +4,10 @@
 #include <vector>
 #include <cstring>
 #include "common.h"
-
-std::map<ValueType, size_t> typeSize{
-    std::make_pair(TYPE_INT8, sizeof(int8_t)),
-    std::make_pair(TYPE_UINT8, sizeof(uint8_t)),
-    std::make_pair(TYPE_INT16, sizeof(int16_t)),
-    std::make_pair(TYPE_UINT16, sizeof(uint16_t)),
-    std::make_pair(TYPE_INT32, sizeof(int32_t)),
-    std::make_pair(TYPE_UINT32, sizeof(uint32_t)),
-    std::make_pair(TYPE_INT64, sizeof(int64_t)),
-    std::make_pair(TYPE_UINT64, sizeof(uint64_t)),
-    std::make_pair(TYPE_FLOAT, sizeof(float)),
-    std::make_pair(TYPE_DOUBLE, sizeof(double)),
-    std::make_pair(TYPE_POINTER, sizeof(void *)),
-    std::make_pair(TYPE_BOOL, sizeof(bool))};
+#include "call_frame.h"
+#include "struct_type.h"
+#include "callback.h"
+#include "array_type.h"
 
 ValueType GetTypeFromString(const std::string &typeStr, Napi::Env env)
 {
@@ -45,138 +35,380 @@ ValueType GetTypeFromString(const std::string &typeStr, Napi::Env env)
         return TYPE_DOUBLE;
     if (typeStr == "string")
         return TYPE_STRING;
+    if (typeStr == "wstring")
+        return TYPE_WSTRING;
     if (typeStr == "pointer")
         return TYPE_POINTER;
     if (typeStr == "bool")
         return TYPE_BOOL;
+    if (typeStr == "buffer")
+        return TYPE_BUFFER;
+    if (typeStr == "uint8*")
+        return TYPE_UINT8_PTR;
+    if (typeStr == "int32*")
+        return TYPE_INT32_PTR;
+    if (typeStr == "double*")
+        return TYPE_DOUBLE_PTR;
+    if (typeStr == "callback")
+        return TYPE_CALLBACK;
+    if (typeStr.size() > 2 && typeStr.compare(typeStr.size() - 2, 2, "[]") == 0)
+    {
+        ValueType element = GetTypeFromString(typeStr.substr(0, typeStr.size() - 2), env);
+        if (element >= TYPE_INT8 && element <= TYPE_DOUBLE)
+        {
+            // The array types follow the element types in the same order.
+            return static_cast<ValueType>(TYPE_INT8_ARRAY + (element - TYPE_INT8));
+        }
+    }
     throw Napi::Error::New(env, "Unknown type: " + typeStr);
 }
 
-void *ConvertJsValueToNative(Napi::Value value, ValueType type, std::vector<void *> &allocations)
+StringReturn GetStringReturnFromString(const std::string &modeStr, Napi::Env env)
 {
-    if (value.IsNull() || value.IsUndefined())
+    if (modeStr == "string")
+        return STRING_UTF8;
+    if (modeStr == "latin1")
+        return STRING_LATIN1;
+    if (modeStr == "buffer")
+        return STRING_BUFFER;
+    if (modeStr == "external")
+        return STRING_EXTERNAL;
+    throw Napi::TypeError::New(env, "Unknown string return mode: " + modeStr);
+}
+
+size_t GetTypeSize(ValueType type)
+{
+    switch (type)
     {
-        return nullptr;
+    case TYPE_INT8:
+        return sizeof(int8_t);
+    case TYPE_UINT8:
+        return sizeof(uint8_t);
+    case TYPE_INT16:
+        return sizeof(int16_t);
+    case TYPE_UINT16:
+        return sizeof(uint16_t);
+    case TYPE_INT32:
+        return sizeof(int32_t);
+    case TYPE_UINT32:
+        return sizeof(uint32_t);
+    case TYPE_INT64:
+        return sizeof(int64_t);
+    case TYPE_UINT64:
+        return sizeof(uint64_t);
+    case TYPE_FLOAT:
+        return sizeof(float);
+    case TYPE_DOUBLE:
+        return sizeof(double);
+    case TYPE_STRING:
+        return sizeof(char *);
+    case TYPE_WSTRING:
+        return sizeof(char16_t *);
+    case TYPE_POINTER:
+    case TYPE_BUFFER:
+    case TYPE_UINT8_PTR:
+    case TYPE_INT32_PTR:
+    case TYPE_DOUBLE_PTR:
+    case TYPE_STRUCT_PTR:
+    case TYPE_CALLBACK:
+        return sizeof(void *);
+    case TYPE_BOOL:
+        return sizeof(bool);
+    default:
+        return IsArrayType(type) ? sizeof(void *) : 0;
     }
+}
 
-    void *result = nullptr;
+size_t GetTypeAlignment(ValueType type)
+{
+    switch (type)
+    {
+    case TYPE_INT64:
+        return alignof(int64_t);
+    case TYPE_UINT64:
+        return alignof(uint64_t);
+    case TYPE_DOUBLE:
+        return alignof(double);
+    case TYPE_STRING:
+    case TYPE_WSTRING:
+    case TYPE_POINTER:
+    case TYPE_BUFFER:
+    case TYPE_UINT8_PTR:
+    case TYPE_INT32_PTR:
+    case TYPE_DOUBLE_PTR:
+    case TYPE_STRUCT_PTR:
+    case TYPE_CALLBACK:
+        return alignof(void *);
+    default:
+        return GetTypeSize(type) ? GetTypeSize(type) : 1;
+    }
+}
 
-    try
+bool IsBufferType(ValueType type)
+{
+    return type == TYPE_BUFFER || type == TYPE_UINT8_PTR || type == TYPE_INT32_PTR || type == TYPE_DOUBLE_PTR;
+}
+
+bool IsStringType(ValueType type)
+{
+    return type == TYPE_STRING || type == TYPE_WSTRING;
+}
+
+bool IsArrayType(ValueType type)
+{
+    return type >= TYPE_INT8_ARRAY && type <= TYPE_DOUBLE_ARRAY;
+}
+
+ValueType GetArrayElementType(ValueType type)
+{
+    return static_cast<ValueType>(TYPE_INT8 + (type - TYPE_INT8_ARRAY));
+}
+
+// Encodes straight into buffer. A truncated result is detected by the room
+// left over: V8 never splits a character, so it stops at most three bytes
+// short of the end. When the string may not fit, length receives its full
+// UTF-8 size instead.
+bool TryEncodeUtf8(napi_env env, napi_value value, char *buffer, size_t capacity, size_t &length)
+{
+    if (buffer && capacity > 4)
     {
-        switch (type)
-        {
-        case TYPE_INT8:
+        if (napi_get_value_string_utf8(env, value, buffer, capacity, &length) != napi_ok)
         {
-            int8_t *val = new int8_t(value.As<Napi::Number>().Int32Value());
-            allocations.push_back(val);
-            result = val;
-            break;
+            throw Napi::Error::New(env);
         }
-        case TYPE_UINT8:
+        if (length + 4 < capacity)
         {
-            uint8_t *val = new uint8_t(value.As<Napi::Number>().Uint32Value());
-            allocations.push_back(val);
-            result = val;
-            break;
+            return true;
         }
-        case TYPE_INT16:
+    }
+
+    if (napi_get_value_string_utf8(env, value, nullptr, 0, &length) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    return false;
+}
+
+static char *EncodeUtf8(Napi::Value value, CallFrame &frame)
+{
+    napi_env env = value.Env();
+    size_t capacity;
+    char *buffer = static_cast<char *>(frame.Spare(1, capacity));
+    size_t length;
+
+    if (TryEncodeUtf8(env, value, buffer, capacity, length))
+    {
+        frame.Claim(buffer, length + 1);
+        return buffer;
+    }
+
+    buffer = static_cast<char *>(frame.Allocate(length + 1, 1));
+    if (napi_get_value_string_utf8(env, value, buffer, length + 1, &length) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    return buffer;
+}
+
+// UTF-16 is copied unit by unit, so a result shorter than the buffer is
+// complete.
+static char16_t *EncodeUtf16(Napi::Value value, CallFrame &frame)
+{
+    napi_env env = value.Env();
+    size_t capacity;
+    char16_t *buffer = static_cast<char16_t *>(frame.Spare(alignof(char16_t), capacity));
+    size_t length;
+    capacity /= sizeof(char16_t);
+
+    if (buffer && capacity > 1)
+    {
+        if (napi_get_value_string_utf16(env, value, buffer, capacity, &length) != napi_ok)
         {
-            int16_t *val = new int16_t(value.As<Napi::Number>().Int32Value());
-            allocations.push_back(val);
-            result = val;
-            break;
+            throw Napi::Error::New(env);
         }
-        case TYPE_UINT16:
+        if (length + 1 < capacity)
         {
-            uint16_t *val = new uint16_t(value.As<Napi::Number>().Uint32Value());
-            allocations.push_back(val);
-            result = val;
-            break;
+            frame.Claim(buffer, (length + 1) * sizeof(char16_t));
+            return buffer;
         }
-        case TYPE_INT32:
+    }
+
+    if (napi_get_value_string_utf16(env, value, nullptr, 0, &length) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    buffer = static_cast<char16_t *>(frame.Allocate((length + 1) * sizeof(char16_t), alignof(char16_t)));
+    if (napi_get_value_string_utf16(env, value, buffer, length + 1, &length) != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    return buffer;
+}
+
+static bool AcceptsElementType(ValueType type, napi_typedarray_type arrayType)
+{
+    switch (type)
+    {
+    case TYPE_UINT8_PTR:
+        return arrayType == napi_uint8_array || arrayType == napi_uint8_clamped_array;
+    case TYPE_INT32_PTR:
+        return arrayType == napi_int32_array;
+    case TYPE_DOUBLE_PTR:
+        return arrayType == napi_float64_array;
+    default:
+        return true;
+    }
+}
+
+// Address of the memory behind a Buffer, TypedArray, DataView or
+// ArrayBuffer. Typed pointer parameters only take views of their element
+// type; raw ArrayBuffers and DataViews are accepted for any of them.
+static void *GetBackingStore(Napi::Value value, ValueType type)
+{
+    napi_env env = value.Env();
+    void *data = nullptr;
+    napi_status status;
+
+    if (value.IsTypedArray())
+    {
+        napi_typedarray_type arrayType;
+        size_t length;
+        status = napi_get_typedarray_info(env, value, &arrayType, &length, &data, nullptr, nullptr);
+        if (status == napi_ok && !AcceptsElementType(type, arrayType))
         {
-            int32_t *val = new int32_t(value.As<Napi::Number>().Int32Value());
-            allocations.push_back(val);
-            result = val;
-            break;
+            throw Napi::TypeError::New(env, "TypedArray element type does not match the parameter type");
         }
-        case TYPE_UINT32:
+    }
+    else if (value.IsArrayBuffer())
+    {
+        size_t length;
+        status = napi_get_arraybuffer_info(env, value, &data, &length);
+    }
+    else if (value.IsDataView())
+    {
+        size_t length;
+        status = napi_get_dataview_info(env, value, &length, &data, nullptr, nullptr);
+    }
+    else
+    {
+        throw Napi::TypeError::New(env, "Expected a Buffer, TypedArray or ArrayBuffer");
+    }
+
+    if (status != napi_ok)
+    {
+        throw Napi::Error::New(env);
+    }
+    return data;
+}
+
+// Numbers, booleans and pointers: the types that need no frame storage.
+void ConvertJsValueToScalar(Napi::Value value, ValueType type, void *slot)
+{
+    if (value.IsNull() || value.IsUndefined())
+    {
+        memset(slot, 0, GetTypeSize(type));
+        return;
+    }
+
+    switch (type)
+    {
+    case TYPE_INT8:
+        *static_cast<int8_t *>(slot) = static_cast<int8_t>(value.As<Napi::Number>().Int32Value());
+        break;
+    case TYPE_UINT8:
+        *static_cast<uint8_t *>(slot) = static_cast<uint8_t>(value.As<Napi::Number>().Uint32Value());
+        break;
+    case TYPE_INT16:
+        *static_cast<int16_t *>(slot) = static_cast<int16_t>(value.As<Napi::Number>().Int32Value());
+        break;
+    case TYPE_UINT16:
+        *static_cast<uint16_t *>(slot) = static_cast<uint16_t>(value.As<Napi::Number>().Uint32Value());
+        break;
+    case TYPE_INT32:
+        *static_cast<int32_t *>(slot) = value.As<Napi::Number>().Int32Value();
+        break;
+    case TYPE_UINT32:
+        *static_cast<uint32_t *>(slot) = value.As<Napi::Number>().Uint32Value();
+        break;
+    case TYPE_INT64:
+        *static_cast<int64_t *>(slot) = value.As<Napi::BigInt>().Int64Value(nullptr);
+        break;
+    case TYPE_UINT64:
+    {
+        bool lossless = true;
+        *static_cast<uint64_t *>(slot) = value.As<Napi::BigInt>().Uint64Value(&lossless);
+        break;
+    }
+    case TYPE_FLOAT:
+        *static_cast<float *>(slot) = value.As<Napi::Number>().FloatValue();
+        break;
+    case TYPE_DOUBLE:
+        *static_cast<double *>(slot) = value.As<Napi::Number>().DoubleValue();
+        break;
+    case TYPE_POINTER:
+        *static_cast<void **>(slot) = value.IsExternal() ? value.As<Napi::External<void>>().Data() : nullptr;
+        break;
+    case TYPE_CALLBACK:
+        *static_cast<void **>(slot) = CallbackWrapper::AddressOf(value);
+        break;
+    case TYPE_BOOL:
+        *static_cast<bool *>(slot) = value.As<Napi::Boolean>().Value();
+        break;
+    default:
+        throw Napi::Error::New(value.Env(), "Unsupported type in conversion");
+    }
+}
+
+void ConvertJsValueToNative(Napi::Value value, ValueType type, void *slot, CallFrame &frame, const StructLayout *layout)
+{
+    try
+    {
+        switch (type)
         {
-            uint32_t *val = new uint32_t(value.As<Napi::Number>().Uint32Value());
-            allocations.push_back(val);
-            result = val;
+        case TYPE_STRUCT:
+            ConvertStructToNative(value, *layout, slot, &frame);
+            return;
+        case TYPE_STRUCT_PTR:
+            *static_cast<void **>(slot) = GetStructAddress(value, *layout, frame);
+            return;
+        default:
             break;
         }
-        case TYPE_INT64:
+
+        if (value.IsNull() || value.IsUndefined())
         {
-            int64_t *val = new int64_t(value.As<Napi::BigInt>().Int64Value(nullptr));
-            allocations.push_back(val);
-            result = val;
-            break;
+            memset(slot, 0, GetTypeSize(type));
+            return;
         }
-        case TYPE_UINT64:
+
+        switch (type)
         {
-            bool lossless = true;
-            uint64_t *val = new uint64_t(value.As<Napi::BigInt>().Uint64Value(&lossless));
-            allocations.push_back(val);
-            result = val;
+        case TYPE_STRING:
+            *static_cast<char **>(slot) = value.IsString() ? EncodeUtf8(value, frame) : nullptr;
             break;
-        }
-        case TYPE_FLOAT:
-        {
-            float *val = new float(value.As<Napi::Number>().FloatValue());
-            allocations.push_back(val);
-            result = val;
+        case TYPE_WSTRING:
+            *static_cast<char16_t **>(slot) = value.IsString() ? EncodeUtf16(value, frame) : nullptr;
             break;
-        }
-        case TYPE_DOUBLE:
-        {
-            double *val = new double(value.As<Napi::Number>().DoubleValue());
-            allocations.push_back(val);
-            result = val;
+        case TYPE_BUFFER:
+        case TYPE_UINT8_PTR:
+        case TYPE_INT32_PTR:
+        case TYPE_DOUBLE_PTR:
+            *static_cast<void **>(slot) = GetBackingStore(value, type);
+            frame.Retain(value);
             break;
-        }
-        case TYPE_STRING:
-        {
-            if (value.IsString())
-            {
-                std::string str = value.As<Napi::String>().Utf8Value();
-                char *val = new char[str.length() + 1];
-                strncpy(val, str.c_str(), str.length());
-                val[str.length()] = '\0';
-                allocations.push_back(val);
-                result = val;
-            }
-            else
-            {
-                result = nullptr;
-            }
+        case TYPE_CALLBACK:
+            ConvertJsValueToScalar(value, type, slot);
+            frame.Retain(value);
             break;
-        }
-        case TYPE_POINTER:
-        {
-            if (value.IsExternal())
-            {
-                void **val = new void *(value.As<Napi::External<void>>().Data());
-                allocations.push_back(val);
-                result = val;
-            }
-            else
+        default:
+            if (IsArrayType(type))
             {
-                result = nullptr;
+                *static_cast<void **>(slot) = ConvertArrayToNative(value, type, frame);
+                break;
             }
+            ConvertJsValueToScalar(value, type, slot);
             break;
         }
-        case TYPE_BOOL:
-        {
-            bool *val = new bool(value.As<Napi::Boolean>().Value());
-            allocations.push_back(val);
-            result = val;
-            break;
-        }
-        default:
-            throw Napi::Error::New(value.Env(), "Unsupported type in conversion");
-        }
     }
     catch (const Napi::Error &)
     {
@@ -190,11 +422,9 @@ void *ConvertJsValueToNative(Napi::Value value, ValueType type, std::vector<void
     {
         throw Napi::Error::New(value.Env(), "Unknown error converting value");
     }
-
-    return result;
 }
 
-Napi::Value ConvertNativeToJsValue(Napi::Env env, void *data, ValueType type)
+Napi::Value ConvertNativeToJsValue(Napi::Env env, void *data, ValueType type, const StructLayout *layout)
 {
     if (data == nullptr)
     {
@@ -228,12 +458,42 @@ Napi::Value ConvertNativeToJsValue(Napi::Env env, void *data, ValueType type)
         case TYPE_DOUBLE:
             return Napi::Number::New(env, *static_cast<double *>(data));
         case TYPE_STRING:
-            return Napi::String::New(env, static_cast<char *>(data));
+        {
+            const char *str = *static_cast<char **>(data);
+            if (!str)
+            {
+                return env.Null();
+            }
+            return Napi::String::New(env, str);
+        }
+        case TYPE_WSTRING:
+        {
+            const char16_t *str = *static_cast<char16_t **>(data);
+            if (!str)
+            {
+                return env.Null();
+            }
+            return Napi::String::New(env, str);
+        }
         case TYPE_POINTER:
+        case TYPE_CALLBACK:
+        case TYPE_BUFFER:
+        case TYPE_UINT8_PTR:
+        case TYPE_INT32_PTR:
+        case TYPE_DOUBLE_PTR:
             return Napi::External<void>::New(env, *static_cast<void **>(data));
         case TYPE_BOOL:
             return Napi::Boolean::New(env, *static_cast<bool *>(data));
+        case TYPE_STRUCT:
+            return StructToJs(env, *layout, data, true);
+        case TYPE_STRUCT_PTR:
+            return StructToJs(env, *layout, *static_cast<void **>(data), false);
         default:
+            if (IsArrayType(type))
+            {
+                // Without a length only the address is known.
+                return Napi::External<void>::New(env, *static_cast<void **>(data));
+            }
             throw Napi::Error::New(env, "Unsupported type in conversion");
         }
     }
@@ -0,0 +1,70 @@
+#include "variadic_signatures.h"
+
+VariadicSignatures::VariadicSignatures(const FunctionInfo &fixed, std::shared_ptr<FunctionStats> stats)
+    : fixed(fixed), stats(std::move(stats))
+{
+    this->fixed.variadic = false;
+    this->fixed.stats = false;
+}
+
+// Extra arguments undergo the default argument promotions. Integers narrower
+// than int already reach the callee widened to a full register or stack
+// word, so only float needs a different type.
+static std::string PromoteType(Napi::Env env, const std::string &typeStr)
+{
+    if (typeStr == "float")
+    {
+        return "double";
+    }
+    if (typeStr == "void" || typeStr == "...")
+    {
+        throw Napi::TypeError::New(env, "Invalid variadic argument type: " + typeStr);
+    }
+    return typeStr;
+}
+
+std::shared_ptr<const CallPlan> VariadicSignatures::Get(const Napi::CallbackInfo &info, size_t first, size_t extra)
+{
+    Napi::Env env = info.Env();
+    std::vector<std::string> types;
+    std::string key;
+    types.reserve(extra);
+    for (size_t i = 0; i < extra; i++)
+    {
+        Napi::Value pair = info[first + i];
+        if (!pair.IsArray() || pair.As<Napi::Array>().Length() != 2 || !pair.As<Napi::Array>().Get(uint32_t(0)).IsString())
+        {
+            throw Napi::TypeError::New(env, "Variadic arguments are passed as [type, value] pairs");
+        }
+        types.push_back(pair.As<Napi::Array>().Get(uint32_t(0)).As<Napi::String>().Utf8Value());
+        key += types.back();
+        key += ',';
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    FunctionInfo shapeInfo = fixed;
+    for (const std::string &typeStr : types)
+    {
+        shapeInfo.paramTypes.push_back(PromoteType(env, typeStr));
+    }
+    auto shape = std::make_shared<CallPlan>(*CompileCallPlan(env, shapeInfo));
+    shape->fixedParams = fixed.paramTypes.size();
+    shape->stats = stats;
+    shape->thunk = nullptr;
+
+    entries.emplace_front(key, shape);
+    index[key] = entries.begin();
+    if (entries.size() > kCapacity)
+    {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    return shape;
+}
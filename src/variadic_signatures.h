@@ -0,0 +1,30 @@
+#pragma once
+
+#include "call_plan.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+// Plans of a variadic function by the types of its extra arguments, which
+// calls pass as [type, value] pairs after the fixed ones. The most recently
+// used shapes are kept; the base plan may be shared across threads, hence
+// the lock.
+class VariadicSignatures
+{
+public:
+    static const size_t kCapacity = 16;
+
+    VariadicSignatures(const FunctionInfo &fixed, std::shared_ptr<FunctionStats> stats);
+
+    // extra is the number of arguments after the fixed ones at info[first].
+    std::shared_ptr<const CallPlan> Get(const Napi::CallbackInfo &info, size_t first, size_t extra);
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<const CallPlan>> Entry;
+
+    FunctionInfo fixed;
+    std::shared_ptr<FunctionStats> stats;
+    std::mutex mutex;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+};
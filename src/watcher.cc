@@ -0,0 +1,530 @@
+#include "watcher.h"
+#include "array_type.h"
+#include "call_frame.h"
+#include "executor.h"
+#include "string_result.h"
+#include "struct_type.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+// A result reduced to what identifies it: the contents of a string or an
+// array rather than its address.
+struct Reading
+{
+    bool null = false;
+    std::string bytes;
+
+    bool operator==(const Reading &other) const { return null == other.null && bytes == other.bytes; }
+};
+
+// A changed result, or the error that ended the watch.
+struct Change
+{
+    Reading reading;
+    bool failed;
+    std::string error;
+};
+
+class Watch;
+
+// One thread schedules the watches of the whole process. A due watch polls
+// on the executor of its library when it has one, behind the calls already
+// queued there, and otherwise on a pool of poll threads. The pool grows
+// while every thread is busy, up to kMaxPollThreads, so a slow device only
+// holds up the others once that many polls are running at the same time.
+class WatchTimer
+{
+public:
+    static const size_t kMaxPollThreads = 32;
+
+    static WatchTimer &Instance();
+
+    void Add(Watch *watch, std::chrono::steady_clock::time_point due);
+    // True when the watch was waiting; false when it is being polled.
+    bool Remove(Watch *watch);
+    // Polls the watch on a pool thread.
+    void Dispatch(Watch *watch);
+
+private:
+    void Run();
+    void Work();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::multimap<std::chrono::steady_clock::time_point, Watch *> schedule;
+    bool started = false;
+    std::condition_variable pollReady;
+    std::deque<Watch *> polls;
+    size_t pollThreads = 0;
+    size_t idleThreads = 0;
+};
+
+class Watch
+{
+public:
+    Watch(std::shared_ptr<const CallPlan> plan, std::shared_ptr<Executor> executor, uint64_t intervalNs)
+        : plan(plan), executor(std::move(executor)), frame(*plan), intervalNs(intervalNs)
+    {
+        frame.RetainValues();
+    }
+
+    CallFrame &Frame() { return frame; }
+    void Start(Napi::Env env, Napi::Function onChange, const std::shared_ptr<Watch> &self);
+    void Stop();
+    void Ref(Napi::Env env);
+    void Unref(Napi::Env env);
+    void Fire();
+    void Poll();
+
+private:
+    static void Deliver(Napi::Env env, Napi::Function onChange, Watch *watch, Change *change);
+
+    typedef Napi::TypedThreadSafeFunction<Watch, Change, &Watch::Deliver> Changes;
+
+    void Finish();
+    void Read(Reading &reading);
+    Napi::Value ToJs(Napi::Env env, const Reading &reading) const;
+
+    std::shared_ptr<const CallPlan> plan;
+    std::shared_ptr<Executor> executor;
+    CallFrame frame;
+    uint64_t intervalNs;
+    // Polls of one watch never overlap, so only one thread at a time uses
+    // these.
+    Reading previous;
+    bool first = true;
+    bool failed = false;
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool stopping = false;
+    // Set once the watch left the schedule for good and released the
+    // thread-safe function.
+    bool done = false;
+    // JS thread only: set by Stop() and when a poll failed, after which
+    // the thread-safe function may be gone.
+    bool stopped = false;
+    Changes changes;
+};
+
+WatchTimer &WatchTimer::Instance()
+{
+    // Never destroyed: its thread may still wait when the process exits.
+    static WatchTimer *timer = new WatchTimer();
+    return *timer;
+}
+
+void WatchTimer::Add(Watch *watch, std::chrono::steady_clock::time_point due)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!started)
+    {
+        std::thread(&WatchTimer::Run, this).detach();
+        started = true;
+    }
+    if (schedule.emplace(due, watch) == schedule.begin())
+    {
+        wake.notify_one();
+    }
+}
+
+bool WatchTimer::Remove(Watch *watch)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = schedule.begin(); it != schedule.end(); ++it)
+    {
+        if (it->second == watch)
+        {
+            schedule.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called by the timer thread, without the lock.
+void WatchTimer::Dispatch(Watch *watch)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        polls.push_back(watch);
+        if (polls.size() <= idleThreads)
+        {
+            pollReady.notify_one();
+            return;
+        }
+        if (pollThreads < kMaxPollThreads)
+        {
+            try
+            {
+                std::thread(&WatchTimer::Work, this).detach();
+                pollThreads++;
+                return;
+            }
+            catch (const std::system_error &)
+            {
+            }
+        }
+        if (pollThreads > 0)
+        {
+            return;
+        }
+        polls.pop_back();
+    }
+
+    // No thread could be started at all.
+    watch->Poll();
+}
+
+void WatchTimer::Work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        idleThreads++;
+        pollReady.wait(lock, [this]
+                       { return !polls.empty(); });
+        idleThreads--;
+
+        Watch *watch = polls.front();
+        polls.pop_front();
+        lock.unlock();
+        watch->Poll();
+        lock.lock();
+    }
+}
+
+void WatchTimer::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        if (schedule.empty())
+        {
+            wake.wait(lock);
+            continue;
+        }
+        auto next = schedule.begin();
+        if (next->first > std::chrono::steady_clock::now())
+        {
+            wake.wait_until(lock, next->first);
+            continue;
+        }
+
+        Watch *watch = next->second;
+        schedule.erase(next);
+        lock.unlock();
+        watch->Fire();
+        lock.lock();
+    }
+}
+
+// The timer and the executor only hold the watch while it is scheduled or
+// polled. The finalizer runs on the JS thread once the watch released the
+// function, or while the environment is torn down, and holds the watch
+// until a poll in progress has finished.
+void Watch::Start(Napi::Env env, Napi::Function onChange, const std::shared_ptr<Watch> &self)
+{
+    changes = Changes::New(
+        env, onChange, "ffi-libraries:watch", 0, 1, this,
+        [](Napi::Env, std::shared_ptr<Watch> *self, Watch *watch)
+        {
+            watch->Stop();
+            std::unique_lock<std::mutex> lock(watch->mutex);
+            watch->finished.wait(lock, [watch]
+                                 { return watch->done; });
+            lock.unlock();
+            delete self;
+        },
+        new std::shared_ptr<Watch>(self));
+
+    try
+    {
+        WatchTimer::Instance().Add(this, std::chrono::steady_clock::now());
+    }
+    catch (const std::exception &e)
+    {
+        done = true;
+        changes.Release();
+        throw Napi::Error::New(env, std::string("Failed to start watch thread: ") + e.what());
+    }
+}
+
+// JS thread only. Results still queued are dropped; a call in progress
+// finishes first.
+void Watch::Stop()
+{
+    stopped = true;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping)
+    {
+        return;
+    }
+    stopping = true;
+    if (WatchTimer::Instance().Remove(this))
+    {
+        Finish();
+    }
+}
+
+void Watch::Ref(Napi::Env env)
+{
+    if (!stopped)
+    {
+        changes.Ref(env);
+    }
+}
+
+void Watch::Unref(Napi::Env env)
+{
+    if (!stopped)
+    {
+        changes.Unref(env);
+    }
+}
+
+// Timer thread. An executor that is stopping leaves the poll to the pool.
+void Watch::Fire()
+{
+    if (executor && executor->Post([this]
+                                   { Poll(); }))
+    {
+        return;
+    }
+    WatchTimer::Instance().Dispatch(this);
+}
+
+// Polls at a fixed rate: the interval counts from the start of each call, so
+// a call slower than the interval is followed by the next one at once. A
+// poll still queued when the watch stops no longer calls the function.
+void Watch::Poll()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+        {
+            Finish();
+            return;
+        }
+    }
+
+    auto due = std::chrono::steady_clock::now() + std::chrono::nanoseconds(intervalNs);
+
+    Change *change = nullptr;
+    try
+    {
+        Reading reading;
+        Read(reading);
+        if (first || !(reading == previous))
+        {
+            change = new Change{reading, false, std::string()};
+            previous = std::move(reading);
+            first = false;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        change = new Change{Reading(), true, e.what()};
+        failed = true;
+    }
+
+    // Fails only while the environment is torn down.
+    if (change && changes.NonBlockingCall(change) != napi_ok)
+    {
+        delete change;
+        failed = true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!stopping && !failed)
+    {
+        WatchTimer::Instance().Add(this, due);
+        return;
+    }
+    Finish();
+}
+
+// With the watch's lock held, once no timer or thread will touch it again.
+void Watch::Finish()
+{
+    done = true;
+    finished.notify_all();
+    changes.Release();
+}
+
+void Watch::Read(Reading &reading)
+{
+    uint64_t start = plan->stats ? MonotonicNs() : 0;
+    frame.Invoke();
+    if (plan->stats)
+    {
+        plan->stats->calls.fetch_add(1, std::memory_order_relaxed);
+        plan->stats->native.Record(MonotonicNs() - start);
+    }
+
+    void *result = frame.Result();
+    ValueType type = plan->returnType;
+    if (type == TYPE_STRING)
+    {
+        char *str = *static_cast<char **>(result);
+        reading.null = !str;
+        if (str)
+        {
+            reading.bytes.assign(str);
+            ReleaseString(*plan, str, plan->freePlan ? STRING_FREE_FUNCTION : STRING_BORROWED);
+            *static_cast<char **>(result) = nullptr;
+        }
+    }
+    else if (type == TYPE_WSTRING)
+    {
+        const char16_t *str = *static_cast<char16_t **>(result);
+        reading.null = !str;
+        if (str)
+        {
+            reading.bytes.assign(reinterpret_cast<const char *>(str),
+                                 std::char_traits<char16_t>::length(str) * sizeof(char16_t));
+        }
+    }
+    else if (IsArrayType(type))
+    {
+        const char *data = *static_cast<char **>(result);
+        reading.null = !data;
+        if (data)
+        {
+            reading.bytes.assign(data, frame.ResultLength() * GetTypeSize(GetArrayElementType(type)));
+        }
+    }
+    else
+    {
+        reading.bytes.assign(static_cast<const char *>(result), plan->returnSize);
+    }
+}
+
+Napi::Value Watch::ToJs(Napi::Env env, const Reading &reading) const
+{
+    if (reading.null)
+    {
+        return env.Null();
+    }
+
+    ValueType type = plan->returnType;
+    switch (type)
+    {
+    case TYPE_STRING:
+        return StringResultToJs(env, *plan, const_cast<char *>(reading.bytes.c_str()), STRING_BORROWED);
+    case TYPE_WSTRING:
+    {
+        std::u16string text(reading.bytes.size() / sizeof(char16_t), u'\0');
+        memcpy(&text[0], reading.bytes.data(), reading.bytes.size());
+        return Napi::String::New(env, text);
+    }
+    case TYPE_STRUCT:
+        return StructToJs(env, *plan->returnLayout, const_cast<char *>(reading.bytes.data()), true);
+    default:
+        break;
+    }
+
+    if (IsArrayType(type))
+    {
+        return ArrayResultToJs(env, type, reading.bytes.data(), reading.bytes.size() / GetTypeSize(GetArrayElementType(type)));
+    }
+
+    alignas(16) uint8_t slot[16] = {};
+    memcpy(slot, reading.bytes.data(), reading.bytes.size());
+    return ConvertNativeToJsValue(env, slot, type, plan->returnLayout.get());
+}
+
+// A throwing onChange is reported as an uncaught exception; the loop goes
+// on.
+void Watch::Deliver(Napi::Env env, Napi::Function onChange, Watch *watch, Change *change)
+{
+    std::unique_ptr<Change> owned(change);
+    if (env == nullptr || watch->stopped)
+    {
+        return;
+    }
+
+    try
+    {
+        if (owned->failed)
+        {
+            watch->stopped = true;
+            onChange.Call({Napi::Error::New(env, owned->error).Value(), env.Undefined()});
+        }
+        else
+        {
+            onChange.Call({env.Null(), watch->ToJs(env, owned->reading)});
+        }
+    }
+    catch (const Napi::Error &e)
+    {
+        napi_fatal_exception(env, e.Value());
+    }
+}
+
+static Napi::Value StartWatch(const Napi::CallbackInfo &info, const std::shared_ptr<const CallPlan> &plan,
+                              const std::shared_ptr<Executor> &executor)
+{
+    Napi::Env env = info.Env();
+    Napi::Value onChange = info[info.Length() > 0 ? info.Length() - 1 : 0];
+    if (info.Length() < 2 || !info[0].IsArray() || !onChange.IsFunction())
+    {
+        throw Napi::TypeError::New(env, "Expected watch(args, [options], onChange)");
+    }
+    if (plan->variadic || plan->returnType == TYPE_VOID)
+    {
+        throw Napi::TypeError::New(env, "watch needs a non-variadic function with a return value");
+    }
+    double intervalMs = 1000;
+    if (info.Length() > 2 && info[1].IsObject() && info[1].As<Napi::Object>().Has("intervalMs"))
+    {
+        intervalMs = info[1].As<Napi::Object>().Get("intervalMs").ToNumber().DoubleValue();
+        if (!(intervalMs >= 1))
+        {
+            throw Napi::RangeError::New(env, "intervalMs must be at least 1");
+        }
+    }
+
+    auto watch = std::make_shared<Watch>(plan, executor, static_cast<uint64_t>(intervalMs * 1e6));
+    Napi::Array args = info[0].As<Napi::Array>();
+    CallFrame &frame = watch->Frame();
+    for (size_t i = 0; i < plan->paramTypes.size(); i++)
+    {
+        if (i < args.Length())
+        {
+            ConvertJsValueToNative(args.Get(static_cast<uint32_t>(i)), plan->paramTypes[i], frame.Slot(i), frame,
+                                   plan->paramLayouts[i].get());
+        }
+        else
+        {
+            memset(frame.Slot(i), 0, plan->paramSizes[i]);
+        }
+    }
+
+    watch->Start(env, onChange.As<Napi::Function>(), watch);
+
+    Napi::Object handle = Napi::Object::New(env);
+    handle.Set("stop", Napi::Function::New(env, [watch](const Napi::CallbackInfo &cbInfo) -> Napi::Value {
+        watch->Stop();
+        return cbInfo.Env().Undefined(); }));
+    handle.Set("ref", Napi::Function::New(env, [watch](const Napi::CallbackInfo &cbInfo) -> Napi::Value {
+        watch->Ref(cbInfo.Env());
+        return cbInfo.This(); }));
+    handle.Set("unref", Napi::Function::New(env, [watch](const Napi::CallbackInfo &cbInfo) -> Napi::Value {
+        watch->Unref(cbInfo.Env());
+        return cbInfo.This(); }));
+    return handle;
+}
+
+Napi::Function CreateWatchWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                  std::shared_ptr<Executor> executor)
+{
+    return Napi::Function::New(env, [plan, closed, executor](const Napi::CallbackInfo &cbInfo) -> Napi::Value {
+        CheckOpen(cbInfo.Env(), closed);
+        return StartWatch(cbInfo, plan, executor); });
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "call_plan.h"
+
+class Executor;
+
+// fn.watch(args, { intervalMs }, onChange) calls the function with the same
+// arguments every intervalMs, on the library executor when there is one and
+// otherwise on a pool of poll threads shared by all watches, and calls
+// onChange(null, value) on the JS thread only when the result differs from
+// the previous one. Strings and arrays compare by content. The returned
+// handle has stop(), and ref() and unref() like a timer. A running watch
+// keeps polling after the library is closed, until it is stopped.
+Napi::Function CreateWatchWrapper(Napi::Env env, std::shared_ptr<const CallPlan> plan, ClosedFlag closed,
+                                  std::shared_ptr<Executor> executor);